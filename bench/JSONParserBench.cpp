@@ -0,0 +1,126 @@
+// Time and peak memory of loading a workflows config three ways: the
+// `ifstream >> json` parse used before, parseFileStrict (mmap, whole DOM)
+// and streamFile (mmap, one workflow at a time). Configs of 1, 10 and
+// 100 MB are generated into `dir` first. Each parse runs in its own child
+// process so its peak RSS is not hidden by an earlier, bigger one. Not
+// built by default:
+//   cmake --build build --target jsonparser-bench && ./build/jsonparser-bench [dir] [runs]
+#include "JSONParser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+using nlohmann::json;
+
+namespace {
+using Clock = chrono::steady_clock;
+
+// Workflows shaped like config/workflows.json, about 800 bytes each
+void generate(const string& path, size_t bytes) {
+    ofstream out(path, ios::trunc);
+    out << "{\"settings\": {\"threads\": 4}, \"workflows\": [\n";
+    size_t written = 0;
+    for (size_t i = 0; written < bytes; ++i) {
+        json wf = {
+            {"name", "Workflow" + to_string(i)},
+            {"schedule", "*/15 9-17 * * 1-5"},
+            {"rule", {{"if", {{"time", "between 09:00 and 17:00"}, {"file", "exists /tmp/trigger" + to_string(i)}}}}},
+            {"actions", {
+                {{"type", "EmailPlugin"}, {"params", {{"recipient", "user" + to_string(i) + "@example.com"},
+                                                       {"subject", "Daily report " + to_string(i)},
+                                                       {"content", string(200, 'r')}}}},
+                {{"type", "MessagePlugin"}, {"params", {{"recipient", "+100000" + to_string(i)},
+                                                         {"content", string(120, 'm')}, {"delay", 5}}}},
+                {{"type", "CompressAction"}, {"params", "/var/data/project_" + to_string(i)}}
+            }}
+        };
+        string text = (i ? ",\n" : "") + wf.dump(2);
+        out << text;
+        written += text.size();
+    }
+    out << "\n]}\n";
+}
+
+struct Sample {
+    double ms;
+    long peakKb;
+    size_t workflows;
+};
+
+// Runs `parse` in a child and reports its wall time and peak RSS
+Sample measure(const function<size_t()>& parse) {
+    int fds[2];
+    if (pipe(fds) != 0) return { 0, 0, 0 };
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        auto start = Clock::now();
+        size_t n = parse();
+        Sample s{ chrono::duration<double, milli>(Clock::now() - start).count(), 0, n };
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        s.peakKb = usage.ru_maxrss;
+        ssize_t ignored = write(fds[1], &s, sizeof(s));
+        (void)ignored;
+        _exit(0);
+    }
+    close(fds[1]);
+    Sample s{ 0, 0, 0 };
+    if (read(fds[0], &s, sizeof(s)) != sizeof(s)) cerr << "child failed\n";
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return s;
+}
+
+// Median time and highest peak over `runs`
+Sample best(const function<size_t()>& parse, int runs) {
+    vector<Sample> samples;
+    for (int r = 0; r < runs; ++r) samples.push_back(measure(parse));
+    sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.ms < b.ms; });
+    Sample s = samples[samples.size() / 2];
+    for (const Sample& o : samples) s.peakKb = max(s.peakKb, o.peakKb);
+    return s;
+}
+}
+
+int main(int argc, char** argv) {
+    string dir = argc > 1 ? argv[1] : "/tmp";
+    int runs = argc > 2 ? max(1, stoi(argv[2])) : 3;
+
+    printf("%-8s %10s  %-20s %-20s %-20s\n", "size", "workflows", "ifstream >> json", "parseFileStrict",
+           "streamFile");
+    for (size_t mb : { 1, 10, 100 }) {
+        string path = dir + "/flowforge-bench-" + to_string(mb) + "mb.json";
+        generate(path, mb * 1024 * 1024);
+
+        Sample legacy = best([&] {
+            ifstream in(path);
+            json j;
+            in >> j;
+            return j["workflows"].size();
+        }, runs);
+        Sample dom = best([&] { return JSONParser::parseFileStrict(path)["workflows"].size(); }, runs);
+        Sample streamed = best([&] {
+            size_t n = 0;
+            JSONParser::streamFile(path, "workflows", [&n](json&& wf) { n += wf.is_object(); });
+            return n;
+        }, runs);
+
+        auto cell = [](const Sample& s) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%7.1f ms %5ld MB", s.ms, s.peakKb / 1024);
+            return string(buf);
+        };
+        printf("%-8s %10zu  %-20s %-20s %-20s\n", (to_string(mb) + " MB").c_str(), streamed.workflows,
+               cell(legacy).c_str(), cell(dom).c_str(), cell(streamed).c_str());
+        remove(path.c_str());
+    }
+}
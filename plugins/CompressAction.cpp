@@ -51,6 +51,49 @@ struct CentralDirectoryHeader {
     uint32_t local_header_offset = 0;
 };
 
+// Follows the data when flag bit 3 is set; the ZIP64 form has 8-byte sizes
+struct DataDescriptor {
+    uint32_t signature = 0x08074b50;
+    uint32_t crc32 = 0;
+    uint32_t compressed_size = 0;
+    uint32_t uncompressed_size = 0;
+};
+
+struct DataDescriptor64 {
+    uint32_t signature = 0x08074b50;
+    uint32_t crc32 = 0;
+    uint64_t compressed_size = 0;
+    uint64_t uncompressed_size = 0;
+};
+
+// Local header extra field of a ZIP64 entry; real sizes are in the descriptor
+struct Zip64LocalExtra {
+    uint16_t tag = 0x0001;
+    uint16_t size = 16;
+    uint64_t uncompressed_size = 0;
+    uint64_t compressed_size = 0;
+};
+
+struct Zip64EndOfCentralDirectory {
+    uint32_t signature = 0x06064b50;
+    uint64_t record_size = sizeof(Zip64EndOfCentralDirectory) - 12;
+    uint16_t version_made = 45;
+    uint16_t version_needed = 45;
+    uint32_t disk_number = 0;
+    uint32_t central_dir_disk = 0;
+    uint64_t num_entries_disk = 0;
+    uint64_t num_entries_total = 0;
+    uint64_t central_dir_size = 0;
+    uint64_t central_dir_offset = 0;
+};
+
+struct Zip64EndOfCentralDirectoryLocator {
+    uint32_t signature = 0x07064b50;
+    uint32_t zip64_eocd_disk = 0;
+    uint64_t zip64_eocd_offset = 0;
+    uint32_t total_disks = 1;
+};
+
 struct EndOfCentralDirectory {
     uint32_t signature = 0x06054b50;
     uint16_t disk_number = 0;
@@ -65,6 +108,32 @@ struct EndOfCentralDirectory {
 
 class CompressAction : public IAction {
 private:
+    // Files are streamed through fixed buffers, so memory use does not
+    // depend on the size of what is archived
+    static constexpr size_t kChunkSize = 64 * 1024;
+    static constexpr uint16_t kFlagDataDescriptor = 0x0008;
+    static constexpr uint32_t kMax32 = 0xFFFFFFFF;
+    // Files above this get a ZIP64 entry up front; the margin covers deflate
+    // growing incompressible input slightly
+    static constexpr uint64_t kZip64Threshold = 0xFF000000;
+
+    struct Entry {
+        string name;
+        uint16_t mod_time;
+        uint16_t mod_date;
+        uint32_t crc32;
+        uint64_t compressed_size;
+        uint64_t uncompressed_size;
+        uint64_t local_header_offset;
+    };
+
+    // One deflate stream per instance, reset for every file; instances are
+    // pooled, so it also outlives a single archive
+    z_stream zs_{};
+    bool zsReady_ = false;
+    vector<char> in_;
+    vector<char> out_;
+
     // Convert DOS time/date format
     uint16_t dos_time(time_t t) {
         tm* tm = localtime(&t);
@@ -76,71 +145,39 @@ private:
         return ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
     }
 
-    // Compress data using zlib
-    vector<uint8_t> compressData(const vector<uint8_t>& data) {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
-
-        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
-            throw runtime_error("Failed to initialize zlib deflate");
-        }
-
-        zs.next_in = (Bytef*)data.data();
-        zs.avail_in = data.size();
-
-        vector<uint8_t> compressed;
-        compressed.reserve(data.size());
-
-        int ret;
-        uint8_t buffer[8192];
-        do {
-            zs.next_out = buffer;
-            zs.avail_out = sizeof(buffer);
-
-            ret = deflate(&zs, Z_FINISH);
-
-            if (compressed.size() + (sizeof(buffer) - zs.avail_out) > compressed.capacity()) {
-                compressed.reserve(compressed.capacity() * 2);
-            }
-
-            compressed.insert(compressed.end(), buffer, buffer + (sizeof(buffer) - zs.avail_out));
-        } while (ret == Z_OK);
-
-        deflateEnd(&zs);
-
-        if (ret != Z_STREAM_END) {
-            throw runtime_error("Compression failed");
-        }
+    template <typename T>
+    static void writeStruct(ofstream& zip_file, const T& value, uint64_t& offset) {
+        zip_file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        offset += sizeof(value);
+    }
 
-        return compressed;
+    static void writeBytes(ofstream& zip_file, const char* data, size_t size, uint64_t& offset) {
+        zip_file.write(data, size);
+        offset += size;
     }
 
-    // Calculate CRC32
-    uint32_t calculate_crc32(const vector<uint8_t>& data) {
-        uint32_t crc = 0xFFFFFFFF;
-        for (uint8_t byte : data) {
-            crc = crc32_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    void resetDeflate() {
+        if (!zsReady_) {
+            if (deflateInit2(&zs_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw runtime_error("Failed to initialize zlib deflate");
+            }
+            zsReady_ = true;
+            in_.resize(kChunkSize);
+            out_.resize(kChunkSize);
+        } else if (deflateReset(&zs_) != Z_OK) {
+            throw runtime_error("Failed to reset zlib deflate");
         }
-        return crc ^ 0xFFFFFFFF;
     }
 
-    // CRC32 lookup table
-    static const uint32_t crc32_table[256];
-
-    // Add file to ZIP
+    // Add file to ZIP: local header with flag bit 3, the data deflated chunk
+    // by chunk, then a data descriptor with the CRC and sizes
     void addFileToZip(ofstream& zip_file, const fs::path& file_path, const string& entry_name,
-                     vector<CentralDirectoryHeader>& central_headers, vector<string>& filenames, uint32_t& local_header_offset) {
-        // Read file data
+                      vector<Entry>& entries, uint64_t& offset) {
         ifstream file(file_path, ios::binary);
         if (!file) {
             throw runtime_error("Cannot open file: " + file_path.string());
         }
-
-        vector<uint8_t> file_data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
-        file.close();
-
-        // Compress data
-        vector<uint8_t> compressed_data = compressData(file_data);
+        bool zip64 = fs::file_size(file_path) >= kZip64Threshold;
 
         // Get file times
         auto file_time = fs::last_write_time(file_path);
@@ -150,37 +187,100 @@ private:
             )
         );
 
-        // Create local file header
+        Entry entry{ entry_name, dos_time(t), dos_date(t), 0, 0, 0, offset };
+
         LocalFileHeader local_header;
-        local_header.mod_time = dos_time(t);
-        local_header.mod_date = dos_date(t);
-        local_header.crc32 = calculate_crc32(file_data);
-        local_header.compressed_size = compressed_data.size();
-        local_header.uncompressed_size = file_data.size();
+        local_header.flags = kFlagDataDescriptor;
+        local_header.mod_time = entry.mod_time;
+        local_header.mod_date = entry.mod_date;
         local_header.filename_length = entry_name.size();
+        if (zip64) {
+            local_header.version = 45;
+            local_header.compressed_size = kMax32;
+            local_header.uncompressed_size = kMax32;
+            local_header.extra_length = sizeof(Zip64LocalExtra);
+        }
+        writeStruct(zip_file, local_header, offset);
+        writeBytes(zip_file, entry_name.data(), entry_name.size(), offset);
+        if (zip64) writeStruct(zip_file, Zip64LocalExtra{}, offset);
+
+        resetDeflate();
+        uLong crc = crc32(0L, Z_NULL, 0);
+        int flush = Z_NO_FLUSH;
+        while (flush != Z_FINISH) {
+            file.read(in_.data(), in_.size());
+            size_t got = static_cast<size_t>(file.gcount());
+            if (file.bad()) throw runtime_error("Cannot read file: " + file_path.string());
+            flush = file.eof() ? Z_FINISH : Z_NO_FLUSH;
+            crc = crc32(crc, reinterpret_cast<const Bytef*>(in_.data()), static_cast<uInt>(got));
+            entry.uncompressed_size += got;
+
+            zs_.next_in = reinterpret_cast<Bytef*>(in_.data());
+            zs_.avail_in = static_cast<uInt>(got);
+            int ret;
+            do {
+                zs_.next_out = reinterpret_cast<Bytef*>(out_.data());
+                zs_.avail_out = static_cast<uInt>(out_.size());
+                ret = deflate(&zs_, flush);
+                if (ret == Z_STREAM_ERROR) throw runtime_error("Compression failed");
+                size_t produced = out_.size() - zs_.avail_out;
+                writeBytes(zip_file, out_.data(), produced, offset);
+                entry.compressed_size += produced;
+            } while (zs_.avail_out == 0);
+            if (flush == Z_FINISH && ret != Z_STREAM_END) throw runtime_error("Compression failed");
+        }
+        entry.crc32 = static_cast<uint32_t>(crc);
+
+        if (zip64) {
+            DataDescriptor64 descriptor;
+            descriptor.crc32 = entry.crc32;
+            descriptor.compressed_size = entry.compressed_size;
+            descriptor.uncompressed_size = entry.uncompressed_size;
+            writeStruct(zip_file, descriptor, offset);
+        } else {
+            if (entry.compressed_size >= kMax32 || entry.uncompressed_size >= kMax32) {
+                throw runtime_error("File grew past 4 GB while compressing: " + file_path.string());
+            }
+            DataDescriptor descriptor;
+            descriptor.crc32 = entry.crc32;
+            descriptor.compressed_size = static_cast<uint32_t>(entry.compressed_size);
+            descriptor.uncompressed_size = static_cast<uint32_t>(entry.uncompressed_size);
+            writeStruct(zip_file, descriptor, offset);
+        }
+        if (!zip_file) {
+            throw runtime_error("Cannot write ZIP file");
+        }
+        entries.push_back(std::move(entry));
+    }
 
-        // Write local file header
-        zip_file.write(reinterpret_cast<char*>(&local_header), sizeof(local_header));
-        zip_file.write(entry_name.c_str(), entry_name.size());
-
-        // Write compressed data
-        zip_file.write(reinterpret_cast<char*>(compressed_data.data()), compressed_data.size());
-
-        // Create central directory header
-        CentralDirectoryHeader central_header;
-        central_header.mod_time = local_header.mod_time;
-        central_header.mod_date = local_header.mod_date;
-        central_header.crc32 = local_header.crc32;
-        central_header.compressed_size = local_header.compressed_size;
-        central_header.uncompressed_size = local_header.uncompressed_size;
-        central_header.filename_length = local_header.filename_length;
-        central_header.local_header_offset = local_header_offset;
-
-        central_headers.push_back(central_header);
-        filenames.push_back(entry_name);
-
-        // Update offset for next file
-        local_header_offset += sizeof(LocalFileHeader) + entry_name.size() + compressed_data.size();
+    // Central directory record; fields that do not fit go into a ZIP64
+    // extra field, in the order the format prescribes
+    void writeCentralHeader(ofstream& zip_file, const Entry& entry, uint64_t& offset) {
+        string extra;
+        auto put64 = [&extra](uint64_t value) { extra.append(reinterpret_cast<const char*>(&value), 8); };
+        CentralDirectoryHeader header;
+        header.flags = kFlagDataDescriptor;
+        header.mod_time = entry.mod_time;
+        header.mod_date = entry.mod_date;
+        header.crc32 = entry.crc32;
+        header.filename_length = entry.name.size();
+        if (entry.uncompressed_size >= kMax32) put64(entry.uncompressed_size);
+        if (entry.compressed_size >= kMax32) put64(entry.compressed_size);
+        if (entry.local_header_offset >= kMax32) put64(entry.local_header_offset);
+        header.uncompressed_size = static_cast<uint32_t>(min<uint64_t>(entry.uncompressed_size, kMax32));
+        header.compressed_size = static_cast<uint32_t>(min<uint64_t>(entry.compressed_size, kMax32));
+        header.local_header_offset = static_cast<uint32_t>(min<uint64_t>(entry.local_header_offset, kMax32));
+        if (!extra.empty()) {
+            uint16_t tag = 0x0001;
+            uint16_t size = static_cast<uint16_t>(extra.size());
+            extra.insert(0, reinterpret_cast<const char*>(&size), 2);
+            extra.insert(0, reinterpret_cast<const char*>(&tag), 2);
+            header.version_made = header.version_needed = 45;
+            header.extra_length = static_cast<uint16_t>(extra.size());
+        }
+        writeStruct(zip_file, header, offset);
+        writeBytes(zip_file, entry.name.data(), entry.name.size(), offset);
+        writeBytes(zip_file, extra.data(), extra.size(), offset);
     }
 
     // Create ZIP file from directory or single file
@@ -191,9 +291,8 @@ private:
             return false;
         }
 
-        vector<CentralDirectoryHeader> central_headers;
-        vector<string> filenames;
-        uint32_t local_header_offset = 0;
+        vector<Entry> entries;
+        uint64_t offset = 0;
 
         try {
             if (fs::is_directory(source_path)) {
@@ -203,39 +302,51 @@ private:
                         string relative_path = fs::relative(entry.path(), source_path.parent_path()).string();
                         // Normalize path separators to forward slashes for ZIP
                         replace(relative_path.begin(), relative_path.end(), '\\', '/');
-                        addFileToZip(zip_file, entry.path(), relative_path, central_headers, filenames, local_header_offset);
+                        addFileToZip(zip_file, entry.path(), relative_path, entries, offset);
                     }
                 }
             } else if (fs::is_regular_file(source_path)) {
                 // Add single file
                 string filename = source_path.filename().string();
-                addFileToZip(zip_file, source_path, filename, central_headers, filenames, local_header_offset);
+                addFileToZip(zip_file, source_path, filename, entries, offset);
             } else {
                 throw runtime_error("Source is neither a file nor a directory");
             }
 
             // Write central directory
-            uint32_t central_dir_offset = local_header_offset;
-            size_t filename_index = 0;
-            for (const auto& header : central_headers) {
-                zip_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-                // Write filename after header
-                if (filename_index < filenames.size()) {
-                    zip_file.write(filenames[filename_index].c_str(), filenames[filename_index].size());
-                }
-                filename_index++;
+            uint64_t central_dir_offset = offset;
+            for (const auto& entry : entries) {
+                writeCentralHeader(zip_file, entry, offset);
+            }
+            uint64_t central_dir_size = offset - central_dir_offset;
+
+            // ZIP64 end records when a count, size or offset does not fit
+            bool zip64 = entries.size() >= 0xFFFF || central_dir_size >= kMax32 || central_dir_offset >= kMax32;
+            if (zip64) {
+                Zip64EndOfCentralDirectoryLocator locator;
+                locator.zip64_eocd_offset = offset;
+                Zip64EndOfCentralDirectory eocd64;
+                eocd64.num_entries_disk = entries.size();
+                eocd64.num_entries_total = entries.size();
+                eocd64.central_dir_size = central_dir_size;
+                eocd64.central_dir_offset = central_dir_offset;
+                writeStruct(zip_file, eocd64, offset);
+                writeStruct(zip_file, locator, offset);
             }
 
             // Write end of central directory
             EndOfCentralDirectory eocd;
-            eocd.num_entries_disk = central_headers.size();
-            eocd.num_entries_total = central_headers.size();
-            eocd.central_dir_size = central_headers.size() * sizeof(CentralDirectoryHeader);
-            eocd.central_dir_offset = central_dir_offset;
+            eocd.num_entries_disk = static_cast<uint16_t>(min<size_t>(entries.size(), 0xFFFF));
+            eocd.num_entries_total = eocd.num_entries_disk;
+            eocd.central_dir_size = static_cast<uint32_t>(min<uint64_t>(central_dir_size, kMax32));
+            eocd.central_dir_offset = static_cast<uint32_t>(min<uint64_t>(central_dir_offset, kMax32));
 
-            zip_file.write(reinterpret_cast<char*>(&eocd), sizeof(eocd));
+            writeStruct(zip_file, eocd, offset);
 
             zip_file.close();
+            if (!zip_file) {
+                throw runtime_error("Cannot write ZIP file: " + zip_path.string());
+            }
             return true;
 
         } catch (const exception& e) {
@@ -246,6 +357,10 @@ private:
     }
 
 public:
+    ~CompressAction() override {
+        if (zsReady_) deflateEnd(&zs_);
+    }
+
     void execute(const string& params) override {
         try {
             string expanded = PathUtils::expandAndNormalizePath(params);
@@ -286,42 +401,10 @@ public:
     }
 };
 
-// CRC32 lookup table implementation
-const uint32_t CompressAction::crc32_table[256] = {
-    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
-    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
-    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
-    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
-    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
-    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
-    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
-    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
-    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
-    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
-    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
-    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
-    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
-    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
-    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
-    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
-    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
-    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
-    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
-    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
-    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
-    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-};
-
 extern "C" IAction* create_action() {
     return new CompressAction();
 }
+
+extern "C" ActionTraits action_traits() {
+    return ActionTraits{ true, 0 };
+}
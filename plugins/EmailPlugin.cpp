@@ -1,6 +1,5 @@
 #include "../src/IAction.h"
 #include <iostream>
-#include <thread>
 #include <chrono>
 #include <curl/curl.h>
 #include <cstring>
@@ -8,7 +7,6 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <filesystem>
 #include "../src/utils/json.hpp"
 
 using namespace std;
@@ -17,26 +15,25 @@ using json = nlohmann::json;
 // Global curl initialization tracking
 static bool curl_initialized = false;
 
+// Engine services, set by plugin_init when the engine provides them
+static const HostServices* host = nullptr;
+
 // Helper function to log messages
-static const char* LOG_FILE_PATH = "logs/email_plugin.log";
-
-static void log_message(const string& msg) {
-    namespace fs = std::filesystem;
-    try {
-        fs::create_directories("logs");
-    } catch (const std::exception&) {
-        // Best effort: ignore directory creation errors, we'll try to log anyway
+static void log_message(const string& msg, int level = HOST_LOG_INFO) {
+    if (host) {
+        host->log(host->ctx, level, msg.data(), msg.size());
+        return;
     }
+    // Engines without HostServices: only problems are worth reporting
+    if (level >= HOST_LOG_WARN) cerr << "EmailPlugin: " << msg << endl;
+}
 
-    ofstream log(LOG_FILE_PATH, ios::app);
-    if (log) {
-        auto now = chrono::system_clock::now();
-        time_t now_time = chrono::system_clock::to_time_t(now);
-        log << ctime(&now_time) << msg << endl;
-    }
+static void record_metric(const char* name, double value) {
+    if (host) host->metric(host->ctx, name, value);
 }
 
 static int curl_debug_log(CURL*, curl_infotype type, char* data, size_t size, void*) {
+    if (host && !host->log_enabled(host->ctx, HOST_LOG_DEBUG)) return 0;
     string prefix;
     switch (type) {
         case CURLINFO_TEXT:
@@ -70,7 +67,7 @@ static int curl_debug_log(CURL*, curl_infotype type, char* data, size_t size, vo
     }
 
     if (!message.empty()) {
-        log_message(prefix + message);
+        log_message(prefix + message, HOST_LOG_DEBUG);
     }
     return 0;
 }
@@ -102,11 +99,17 @@ static size_t email_read_callback(char* buffer, size_t size, size_t nitems, void
     return to_copy;
 }
 
-class EmailPlugin : public IAction {
+class EmailPlugin : public IActionV2 {
 private:
-    bool sendEmail(const string& to, const string& subject, const string& body) {
-        log_message("sendEmail called for recipient: " + to);
+    // Kept across executions so libcurl can reuse the SMTP connection,
+    // TLS session and DNS cache.
+    CURL* curl_ = nullptr;
 
+    string smtp_user_;
+
+    // Configure the handle for an SMTP session. Options set here survive
+    // across the messages of a batch; only recipient and payload change.
+    bool openSession() {
         // Ensure curl is initialized globally
         if (!curl_initialized) {
             curl_global_init(CURL_GLOBAL_DEFAULT);
@@ -114,9 +117,14 @@ private:
             log_message("Initialized curl globally");
         }
 
-        CURL* curl = curl_easy_init();
+        if (curl_) {
+            curl_easy_reset(curl_);
+        } else {
+            curl_ = curl_easy_init();
+        }
+        CURL* curl = curl_;
         if (!curl) {
-            log_message("Failed to initialize curl handle");
+            log_message("Failed to initialize curl handle", HOST_LOG_ERROR);
             return false;
         }
 
@@ -126,51 +134,28 @@ private:
 
         if (!user_env || !*user_env || !pass_env || !*pass_env) {
             cerr << "Error: SMTP credentials are not configured in environment variables (SMTP_USER, SMTP_PASS)" << endl;
-            log_message("SMTP credentials unavailable from environment variables");
-            curl_easy_cleanup(curl);
+            log_message("SMTP credentials unavailable from environment variables", HOST_LOG_ERROR);
             return false;
         }
 
-        string smtp_user = user_env;
+        smtp_user_ = user_env;
         string smtp_pass = pass_env;
-
-        // Construct email payload
-        string email_payload =
-            "To: " + to + "\r\n" +
-            "From: " + smtp_user + "\r\n" +
-            "Subject: " + subject + "\r\n" +
-            "\r\n" +
-            body + "\r\n";
-
-        EmailPayload payload(email_payload);
-
-        // Set up recipients list
-        struct curl_slist* recipients = NULL;
-    string mail_to = "<" + to + ">";
-    string mail_from = "<" + smtp_user + ">";
-
-        recipients = curl_slist_append(recipients, mail_to.c_str());
-        if (!recipients) {
-            log_message("Failed to create recipients list");
-            curl_easy_cleanup(curl);
-            return false;
-        }
+        string mail_from = "<" + smtp_user_ + ">";
 
         // SMTP URL - using Gmail's SMTP server
         string smtp_url = "smtps://smtp.gmail.com:465";
 
         // Set curl options for SMTP
         curl_easy_setopt(curl, CURLOPT_URL, smtp_url.c_str());
-        curl_easy_setopt(curl, CURLOPT_USERNAME, smtp_user.c_str());
+        curl_easy_setopt(curl, CURLOPT_USERNAME, smtp_user_.c_str());
         curl_easy_setopt(curl, CURLOPT_PASSWORD, smtp_pass.c_str());
         curl_easy_setopt(curl, CURLOPT_MAIL_FROM, mail_from.c_str());
-        curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, recipients);
 
         // Use SMTPS protocol with explicit auth fallback for app passwords
         curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_ALL);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);  // Verify SSL certificate
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);  // Verify host
-    curl_easy_setopt(curl, CURLOPT_LOGIN_OPTIONS, "AUTH=LOGIN");
+        curl_easy_setopt(curl, CURLOPT_LOGIN_OPTIONS, "AUTH=LOGIN");
 
         const char* debug_env = getenv("SMTP_DEBUG");
         if (debug_env && string(debug_env) == "1") {
@@ -181,22 +166,55 @@ private:
         // Set upload for email body
         curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
         curl_easy_setopt(curl, CURLOPT_READFUNCTION, email_read_callback);
-        curl_easy_setopt(curl, CURLOPT_READDATA, &payload);
 
         // Set timeout
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
         curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 20L);
+        return true;
+    }
+
+    // Send one message over the session set up by openSession()
+    bool sendEmail(const string& to, const string& subject, const string& body) {
+        log_message("sendEmail called for recipient: " + to);
+        CURL* curl = curl_;
+
+        // Construct email payload
+        string email_payload =
+            "To: " + to + "\r\n" +
+            "From: " + smtp_user_ + "\r\n" +
+            "Subject: " + subject + "\r\n" +
+            "\r\n" +
+            body + "\r\n";
+
+        EmailPayload payload(email_payload);
+
+        // Set up recipients list
+        struct curl_slist* recipients = NULL;
+        string mail_to = "<" + to + ">";
+
+        recipients = curl_slist_append(recipients, mail_to.c_str());
+        if (!recipients) {
+            log_message("Failed to create recipients list", HOST_LOG_ERROR);
+            return false;
+        }
+
+        curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, recipients);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &payload);
 
         char error_buffer[CURL_ERROR_SIZE] = {0};
         curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
 
         // Perform the request
         log_message("Attempting to send email via SMTP");
+        unsigned long long started = host ? host->now_ns(host->ctx) : 0;
         CURLcode res = curl_easy_perform(curl);
+        if (host) record_metric("smtp_ms", (host->now_ns(host->ctx) - started) / 1e6);
 
-        // Clean up
+        // Clean up; the handle must not keep pointers into this frame
+        curl_easy_setopt(curl, CURLOPT_MAIL_RCPT, NULL);
+        curl_easy_setopt(curl, CURLOPT_READDATA, NULL);
+        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
         curl_slist_free_all(recipients);
-        curl_easy_cleanup(curl);
 
         // Log result
         if (res != CURLE_OK) {
@@ -205,43 +223,86 @@ private:
                 err += " | details: ";
                 err += error_buffer;
             }
-            log_message(err);
+            log_message(err, HOST_LOG_ERROR);
+            record_metric("failed", 1);
             return false;
         } else {
             log_message("Email sent successfully");
+            record_metric("sent", 1);
             return true;
         }
     }
 
-public:
-    void execute(const string& params) override {
-        try {
-            json config = json::parse(params);
-            string recipient = config["recipient"].get<string>();
-            string subject = config.value("subject", "Message from FlowForge");
-            string content = config["content"].get<string>();
-            int delay_minutes = config.value("delay", 0);
+    void deliver(const json& config) {
+        string recipient = config.at("recipient").get<string>();
+        string subject = config.value("subject", "Message from FlowForge");
+        string content = config.at("content").get<string>();
+        // "delay" is handled by the engine before the action is dispatched
+        bool success = sendEmail(recipient, subject, content);
 
-            cout << "EmailPlugin: Will send email in " << delay_minutes << " minutes" << endl;
+        if (!success) throw runtime_error("EmailPlugin failed to send to " + recipient);
+        cout << "EmailPlugin: Successfully sent email to " << recipient << endl;
+    }
 
-            if (delay_minutes > 0) {
-                this_thread::sleep_for(chrono::minutes(delay_minutes));
-            }
+public:
+    ~EmailPlugin() override {
+        if (curl_) curl_easy_cleanup(curl_);
+    }
 
-            bool success = sendEmail(recipient, subject, content);
+    using IActionV2::execute;
 
-            if (success) {
-                cout << "EmailPlugin: Successfully sent email to " << recipient << endl;
-            } else {
-                cerr << "EmailPlugin: Failed to send email to " << recipient << endl;
-            }
+    // Failures are thrown so the engine reports the action as failed,
+    // the same as one failing item of a batch
+    void execute(const json& config) override {
+        if (!openSession()) {
+            cerr << "EmailPlugin: Failed to send email" << endl;
+            throw runtime_error("cannot open SMTP session");
+        }
+        try {
+            deliver(config);
         } catch (const exception& e) {
             cerr << "EmailPlugin Error: " << e.what() << endl;
-            log_message(string("Exception: ") + e.what());
+            log_message(string("Exception: ") + e.what(), HOST_LOG_ERROR);
+            throw;
+        }
+    }
+
+    // One SMTP session for the whole batch: libcurl keeps the connection
+    // open between performs on the same handle.
+    void executeBatch(ParamsSpan batch, BatchResults& results) override {
+        log_message("Sending batch of " + to_string(batch.size()) + " emails");
+        if (!openSession()) {
+            cerr << "EmailPlugin: Failed to send batch of " << batch.size() << " emails" << endl;
+            auto error = make_exception_ptr(runtime_error("cannot open SMTP session"));
+            for (auto& result : results) result = error;
+            return;
+        }
+        size_t i = 0;
+        for (const json& config : batch) {
+            try {
+                deliver(config);
+            } catch (const exception& e) {
+                cerr << "EmailPlugin Error: " << e.what() << endl;
+                log_message(string("Exception: ") + e.what(), HOST_LOG_ERROR);
+                results[i] = current_exception();
+            }
+            ++i;
         }
     }
 };
 
+extern "C" void plugin_init(const HostServices* services) {
+    if (services && services->version >= 1) host = services;
+}
+
 extern "C" IAction* create_action() {
     return new EmailPlugin();
 }
+
+extern "C" IActionV2* create_action_v2() {
+    return new EmailPlugin();
+}
+
+extern "C" ActionTraits action_traits() {
+    return ActionTraits{ true, 0 };
+}
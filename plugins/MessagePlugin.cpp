@@ -1,6 +1,5 @@
 #include "../src/IAction.h"
 #include <iostream>
-#include <thread>
 #include <chrono>
 #include <curl/curl.h>
 #include <cstring>
@@ -14,32 +13,47 @@ using json = nlohmann::json;
 // Global curl initialization tracking
 static bool curl_initialized = false;
 
+// Engine services, set by plugin_init when the engine provides them
+static const HostServices* host = nullptr;
+
 // Helper function to log messages
-static void log_message(const string& msg) {
-    ofstream log("logs/message_plugin.log", ios::app);
-    if (log) {
-        auto now = chrono::system_clock::now();
-        time_t now_time = chrono::system_clock::to_time_t(now);
-        log << ctime(&now_time) << msg << endl;
-        log.close();
+static void log_message(const string& msg, int level = HOST_LOG_INFO) {
+    if (host) {
+        host->log(host->ctx, level, msg.data(), msg.size());
+        return;
     }
+    // Engines without HostServices: only problems are worth reporting
+    if (level >= HOST_LOG_WARN) cerr << "MessagePlugin: " << msg << endl;
+}
+
+static void record_metric(const char* name, double value) {
+    if (host) host->metric(host->ctx, name, value);
 }
 
-class MessagePlugin : public IAction {
+class MessagePlugin : public IActionV2 {
 private:
-    bool sendSMS(const string& to, const string& message) {
-        // Log function entry
-        log_message("sendSMS called for recipient: " + to);
+    // Kept across executions so the HTTPS connection to Twilio stays warm
+    CURL* curl_ = nullptr;
 
+    string twilio_from_;
+
+    // Point the handle at the Twilio API. URL and credentials stay set for
+    // every message of a batch; only the form body changes.
+    bool openSession() {
         // Ensure curl is initialized
         if (!curl_initialized) {
             curl_global_init(CURL_GLOBAL_DEFAULT);
             curl_initialized = true;
         }
 
-        CURL* curl = curl_easy_init();
+        if (curl_) {
+            curl_easy_reset(curl_);
+        } else {
+            curl_ = curl_easy_init();
+        }
+        CURL* curl = curl_;
         if (!curl) {
-            log_message("Failed to initialize curl handle for SMS");
+            log_message("Failed to initialize curl handle for SMS", HOST_LOG_ERROR);
             return false;
         }
 
@@ -50,12 +64,11 @@ private:
 
         string twilio_sid = sid_env ? sid_env : "";
         string twilio_token = token_env ? token_env : "";
-        string twilio_from = from_env ? from_env : "";
+        twilio_from_ = from_env ? from_env : "";
 
-        if (twilio_sid.empty() || twilio_token.empty() || twilio_from.empty()) {
+        if (twilio_sid.empty() || twilio_token.empty() || twilio_from_.empty()) {
             cerr << "Error: TWILIO_SID, TWILIO_TOKEN, and TWILIO_FROM environment variables must be set" << endl;
-            log_message("Missing Twilio credentials");
-            curl_easy_cleanup(curl);
+            log_message("Missing Twilio credentials", HOST_LOG_ERROR);
             return false;
         }
 
@@ -63,8 +76,19 @@ private:
         string url = "https://api.twilio.com/2010-04-01/Accounts/" + twilio_sid + "/Messages.json";
         string auth = twilio_sid + ":" + twilio_token;
 
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_USERPWD, auth.c_str());
+        return true;
+    }
+
+    // Send one SMS over the session set up by openSession()
+    bool sendSMS(const string& to, const string& message) {
+        // Log function entry
+        log_message("sendSMS called for recipient: " + to);
+        CURL* curl = curl_;
+
         // URL-encode parameters
-        char* enc_from = curl_easy_escape(curl, twilio_from.c_str(), 0);
+        char* enc_from = curl_easy_escape(curl, twilio_from_.c_str(), 0);
         char* enc_to = curl_easy_escape(curl, to.c_str(), 0);
         char* enc_body = curl_easy_escape(curl, message.c_str(), 0);
 
@@ -79,56 +103,95 @@ private:
         if (enc_to) curl_free(enc_to);
         if (enc_body) curl_free(enc_body);
 
-        // Set up curl options
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_fields.c_str());
-        curl_easy_setopt(curl, CURLOPT_USERPWD, auth.c_str());
+        // COPYPOSTFIELDS so the handle does not point into this frame afterwards
+        curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, post_fields.c_str());
 
         // Perform request
         log_message("Attempting to send SMS");
+        unsigned long long started = host ? host->now_ns(host->ctx) : 0;
         CURLcode res = curl_easy_perform(curl);
-
-        // Clean up
-        curl_easy_cleanup(curl);
+        if (host) record_metric("request_ms", (host->now_ns(host->ctx) - started) / 1e6);
 
         // Log result
         if (res != CURLE_OK) {
-            log_message(string("CURL error: ") + curl_easy_strerror(res));
+            log_message(string("CURL error: ") + curl_easy_strerror(res), HOST_LOG_ERROR);
+            record_metric("failed", 1);
         } else {
             log_message("SMS sent successfully");
+            record_metric("sent", 1);
         }
 
         return (res == CURLE_OK);
     }
 
-public:
-    void execute(const string& params) override {
-        try {
-            json config = json::parse(params);
-            string recipient = config["recipient"].get<string>();
-            string content = config["content"].get<string>();
-            int delay_minutes = config.value("delay", 0);
+    void deliver(const json& config) {
+        string recipient = config.at("recipient").get<string>();
+        string content = config.at("content").get<string>();
+        // "delay" is handled by the engine before the action is dispatched
+        bool success = sendSMS(recipient, content);
 
-            cout << "MessagePlugin: Will send SMS in " << delay_minutes << " minutes" << endl;
+        if (!success) throw runtime_error("MessagePlugin failed to send to " + recipient);
+        cout << "MessagePlugin: Successfully sent SMS to " << recipient << endl;
+    }
 
-            if (delay_minutes > 0) {
-                this_thread::sleep_for(chrono::minutes(delay_minutes));
-            }
+public:
+    ~MessagePlugin() override {
+        if (curl_) curl_easy_cleanup(curl_);
+    }
 
-            bool success = sendSMS(recipient, content);
+    using IActionV2::execute;
 
-            if (success) {
-                cout << "MessagePlugin: Successfully sent SMS to " << recipient << endl;
-            } else {
-                cerr << "MessagePlugin: Failed to send SMS to " << recipient << endl;
-            }
+    // Failures are thrown so the engine reports the action as failed,
+    // the same as one failing item of a batch
+    void execute(const json& config) override {
+        if (!openSession()) {
+            cerr << "MessagePlugin: Failed to send SMS" << endl;
+            throw runtime_error("cannot open HTTP session");
+        }
+        try {
+            deliver(config);
         } catch (const exception& e) {
             cerr << "MessagePlugin Error: " << e.what() << endl;
-            log_message(string("Exception: ") + e.what());
+            log_message(string("Exception: ") + e.what(), HOST_LOG_ERROR);
+            throw;
+        }
+    }
+
+    // All messages of the batch go over the same keep-alive HTTPS connection
+    void executeBatch(ParamsSpan batch, BatchResults& results) override {
+        log_message("Sending batch of " + to_string(batch.size()) + " SMS");
+        if (!openSession()) {
+            cerr << "MessagePlugin: Failed to send batch of " << batch.size() << " SMS" << endl;
+            auto error = make_exception_ptr(runtime_error("cannot open HTTP session"));
+            for (auto& result : results) result = error;
+            return;
+        }
+        size_t i = 0;
+        for (const json& config : batch) {
+            try {
+                deliver(config);
+            } catch (const exception& e) {
+                cerr << "MessagePlugin Error: " << e.what() << endl;
+                log_message(string("Exception: ") + e.what(), HOST_LOG_ERROR);
+                results[i] = current_exception();
+            }
+            ++i;
         }
     }
 };
 
+extern "C" void plugin_init(const HostServices* services) {
+    if (services && services->version >= 1) host = services;
+}
+
 extern "C" IAction* create_action() {
     return new MessagePlugin();
 }
+
+extern "C" IActionV2* create_action_v2() {
+    return new MessagePlugin();
+}
+
+extern "C" ActionTraits action_traits() {
+    return ActionTraits{ true, 0 };
+}
@@ -0,0 +1,75 @@
+#include "ActionBatcher.h"
+#include "PluginLoader.h"
+using namespace std;
+
+ActionBatcher& ActionBatcher::instance() {
+    static ActionBatcher inst;
+    return inst;
+}
+
+ActionBatcher::Queue& ActionBatcher::queueFor(const string& pluginPath) {
+    lock_guard<mutex> lock(mtx_);
+    auto& q = queues_[pluginPath];
+    if (!q) {
+        q = make_unique<Queue>();
+        auto info = PluginLoader::instance().info(pluginPath);
+        q->limit = info.traits.reusable && info.traits.maxPooled ? info.traits.maxPooled
+                                                                 : PluginLoader::defaultPoolLimit();
+    }
+    return *q;
+}
+
+IActionV2::BatchResults ActionBatcher::execute(const string& pluginPath, const vector<const nlohmann::json*>& params) {
+    if (params.empty()) return {};
+    Queue& q = queueFor(pluginPath);
+    Request req;
+    req.params = &params;
+
+    unique_lock<mutex> lock(q.mtx);
+    q.pending.push_back(&req);
+    while (!req.done) {
+        if (q.inflight < q.limit && !q.pending.empty()) {
+            vector<Request*> batch;
+            batch.swap(q.pending);
+            ++q.inflight;
+            lock.unlock();
+
+            runBatch(pluginPath, batch);
+
+            lock.lock();
+            --q.inflight;
+            for (Request* r : batch) r->done = true;
+            q.cv.notify_all();
+        } else {
+            q.cv.wait(lock);
+        }
+    }
+    return std::move(req.results);
+}
+
+void ActionBatcher::runBatch(const string& pluginPath, const vector<Request*>& batch) {
+    vector<const nlohmann::json*> merged;
+    const vector<const nlohmann::json*>* items = batch.front()->params;
+    if (batch.size() > 1) {
+        for (Request* r : batch) merged.insert(merged.end(), r->params->begin(), r->params->end());
+        items = &merged;
+    }
+    IActionV2::BatchResults results(items->size());
+    try {
+        auto plugin = PluginLoader::instance().acquire(pluginPath);
+        IActionV2* action = plugin.v2();
+        if (!action) throw runtime_error("plugin '" + pluginPath + "' does not implement IActionV2");
+        action->executeBatch(ParamsSpan(items->data(), items->size()), results);
+    } catch (...) {
+        // Nothing in the batch can be trusted to have run
+        exception_ptr error = current_exception();
+        for (auto& result : results) result = error;
+    }
+    // Hand each submitter the slice for its own items
+    size_t offset = 0;
+    for (Request* r : batch) {
+        size_t count = r->params->size();
+        r->results.assign(results.begin() + offset, results.begin() + offset + count);
+        offset += count;
+    }
+}
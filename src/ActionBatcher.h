@@ -0,0 +1,42 @@
+#pragma once
+#include "IAction.h"
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Coalesces concurrent executions of the same v2 plugin into executeBatch()
+// calls. Submitters queue their params; whoever finds a free slot takes
+// everything queued so far and runs it as one batch while the rest wait.
+// At most one batch per pooled instance is in flight for a plugin, so an
+// idle engine runs each submission immediately and a saturated one batches.
+class ActionBatcher {
+public:
+    static ActionBatcher& instance();
+    // Blocks until every item has been executed. Returns each item's outcome
+    // (null on success), unaffected by other submitters' items in the batch.
+    IActionV2::BatchResults execute(const std::string& pluginPath, const std::vector<const nlohmann::json*>& params);
+private:
+    struct Request {
+        const std::vector<const nlohmann::json*>* params;
+        IActionV2::BatchResults results;
+        bool done = false;
+    };
+    struct Queue {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<Request*> pending;
+        size_t inflight = 0;
+        size_t limit = 1;
+    };
+
+    ActionBatcher() = default;
+    Queue& queueFor(const std::string& pluginPath);
+    static void runBatch(const std::string& pluginPath, const std::vector<Request*>& batch);
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::unique_ptr<Queue>> queues_;
+};
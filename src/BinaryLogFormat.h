@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+// On-disk layout of logs/engine.bin, shared by Logger and
+// flowforge-logdecode. All integers are little-endian.
+//
+//   header  "FFBLOG1\0", u8 ClockUnit, u64 stamp, u64 steady-clock ns,
+//           i64 system-clock ns, all read at process start (rotated
+//           segments repeat the same header, then every site frame)
+//   frames  u8 kind, then
+//     Site:  u32 id, u32 line, u32 file length, file, u32 format length, format
+//     Clock: u64 stamp, u64 steady-clock ns (Tsc logs, before each batch)
+//     Batch: u32 byte length, records
+//
+// A site frame always precedes the first batch that references it. Each
+// record is u64 stamp, u32 thread, u32 site id, u8 argument count, then per
+// argument a LogArg::Type byte and its payload (8 bytes, or u32 length plus
+// bytes for strings). Records within a batch are grouped by thread; the
+// decoder orders them by stamp.
+namespace binlog {
+
+constexpr char kMagic[8] = { 'F', 'F', 'B', 'L', 'O', 'G', '1', '\0' };
+
+enum Frame : uint8_t { Site = 1, Batch = 2, Clock = 3 };
+
+// Stamps are raw TSC readings when the CPU has an invariant TSC, which is
+// about half the cost of a steady_clock read
+enum ClockUnit : uint8_t { SteadyNs = 0, Tsc = 1 };
+
+// Site ID of plain Logger::log(string) lines, format "{}"
+constexpr uint32_t kPlainSite = 0;
+
+}
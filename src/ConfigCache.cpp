@@ -0,0 +1,207 @@
+#include "ConfigCache.h"
+#include "utils/JSONParser.h"
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+using nlohmann::json;
+
+namespace {
+constexpr char kMagic[8] = { 'F', 'F', 'C', 'F', 'G', '2', '\0', '\0' };
+
+struct Header {
+    char magic[8];
+    uint64_t size;
+    int64_t mtimeNs;
+    uint64_t hash;
+    uint32_t count;
+    uint32_t globalsOffset;
+    uint32_t globalsLength;
+    uint32_t indexOffset;
+};
+
+struct Entry {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t offset;
+    uint32_t length;
+    uint64_t hash; // of the definition bytes
+};
+
+template <typename T>
+T readAt(string_view image, size_t offset) {
+    T value;
+    memcpy(&value, image.data() + offset, sizeof(T));
+    return value;
+}
+
+uint64_t fnv1a(string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool inBounds(string_view image, uint64_t offset, uint64_t length) {
+    return offset <= image.size() && length <= image.size() - offset;
+}
+}
+
+ConfigCache::ConfigCache(const string& configPath) {
+    struct stat st;
+    if (::stat(configPath.c_str(), &st) != 0) return;
+    int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    string cachePath = configPath + ".cache";
+
+    file_ = MappedFile(cachePath);
+    image_ = file_.view();
+    if (check()) {
+        Header h = readAt<Header>(image_, 0);
+        if (h.size == static_cast<uint64_t>(st.st_size) && h.mtimeNs == mtimeNs) {
+            valid_ = hit_ = true;
+            return;
+        }
+        if (h.size == static_cast<uint64_t>(st.st_size)) {
+            MappedFile config(configPath);
+            if (config.isOpen() && fnv1a(config.view()) == h.hash) {
+                // Touched but unchanged; store the new mtime so the next
+                // start can skip hashing
+                int64_t seen = config.mtimeNs();
+                int fd = ::open(cachePath.c_str(), O_WRONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                    if (::pwrite(fd, &seen, sizeof(seen), offsetof(Header, mtimeNs)) != sizeof(seen)) {
+                        cerr << "ConfigCache: cannot update " << cachePath << "\n";
+                    }
+                    ::close(fd);
+                }
+                valid_ = hit_ = true;
+                return;
+            }
+        }
+    }
+    file_ = MappedFile();
+    image_ = {};
+    valid_ = build(configPath, cachePath);
+}
+
+bool ConfigCache::check() const {
+    if (image_.size() < sizeof(Header)) return false;
+    Header h = readAt<Header>(image_, 0);
+    return memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 &&
+           inBounds(image_, h.globalsOffset, h.globalsLength) &&
+           inBounds(image_, h.indexOffset, static_cast<uint64_t>(h.count) * sizeof(Entry));
+}
+
+bool ConfigCache::build(const string& configPath, const string& cachePath) {
+    MappedFile config(configPath);
+    if (!config.isOpen()) return false;
+    // Entries loadWorkflows would skip for lacking a name are left out
+    struct Compiled {
+        string name;
+        vector<uint8_t> cbor;
+    };
+    vector<Compiled> compiled;
+    json globals;
+    try {
+        globals = JSONParser::stream(config.view(), "workflows", [&compiled](json&& wf) {
+            if (!wf.is_object()) return;
+            auto name = wf.find("name");
+            if (name == wf.end() || !name->is_string()) return;
+            compiled.push_back({ name->get<string>(), json::to_cbor(wf) });
+        });
+    } catch (const JSONParser::ParseError&) {
+        return false;
+    }
+    auto workflows = globals.find("workflows");
+    if (workflows == globals.end() || !workflows->is_array()) return false;
+    globals.erase(workflows);
+
+    // Stable, so a duplicated name resolves to its first definition as it
+    // does in a full load
+    stable_sort(compiled.begin(), compiled.end(),
+                [](const Compiled& a, const Compiled& b) { return a.name < b.name; });
+
+    vector<uint8_t> globalsCbor = json::to_cbor(globals);
+
+    Header h{};
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.size = config.size();
+    h.mtimeNs = config.mtimeNs();
+    h.hash = fnv1a(config.view());
+    h.count = static_cast<uint32_t>(compiled.size());
+
+    string& out = built_;
+    out.assign(sizeof(Header), '\0');
+    h.globalsOffset = static_cast<uint32_t>(out.size());
+    h.globalsLength = static_cast<uint32_t>(globalsCbor.size());
+    out.append(reinterpret_cast<const char*>(globalsCbor.data()), globalsCbor.size());
+    out.resize((out.size() + 3) & ~size_t(3));
+    h.indexOffset = static_cast<uint32_t>(out.size());
+    out.resize(out.size() + compiled.size() * sizeof(Entry));
+    for (size_t k = 0; k < compiled.size(); ++k) {
+        Entry e;
+        e.nameOffset = static_cast<uint32_t>(out.size());
+        e.nameLength = static_cast<uint32_t>(compiled[k].name.size());
+        out += compiled[k].name;
+        e.offset = static_cast<uint32_t>(out.size());
+        e.length = static_cast<uint32_t>(compiled[k].cbor.size());
+        e.hash = fnv1a(string_view(reinterpret_cast<const char*>(compiled[k].cbor.data()), compiled[k].cbor.size()));
+        out.append(reinterpret_cast<const char*>(compiled[k].cbor.data()), compiled[k].cbor.size());
+        memcpy(&out[h.indexOffset + k * sizeof(Entry)], &e, sizeof(e));
+    }
+    memcpy(&out[0], &h, sizeof(h));
+    image_ = out;
+    if (out.size() > UINT32_MAX) return false;
+
+    // Concurrent starts each write their own temporary; the last rename
+    // wins. Fsynced before the rename, so a crash cannot leave a short
+    // cache behind under the final name.
+    if (!JSONParser::writeBytes(cachePath, out)) {
+        cerr << "ConfigCache: cannot write " << cachePath << "; using the config without a cache\n";
+    }
+    return true;
+}
+
+json ConfigCache::globals() const {
+    if (!valid_) return json::object();
+    Header h = readAt<Header>(image_, 0);
+    json g = json::from_cbor(image_.begin() + h.globalsOffset, image_.begin() + h.globalsOffset + h.globalsLength,
+                             true, false);
+    return g.is_object() ? g : json::object();
+}
+
+size_t ConfigCache::size() const {
+    return valid_ ? readAt<Header>(image_, 0).count : 0;
+}
+
+optional<json> ConfigCache::find(string_view name) const {
+    if (!valid_) return nullopt;
+    Header h = readAt<Header>(image_, 0);
+    auto entryAt = [&](uint32_t k) { return readAt<Entry>(image_, h.indexOffset + size_t(k) * sizeof(Entry)); };
+    auto nameOf = [&](const Entry& e) {
+        return inBounds(image_, e.nameOffset, e.nameLength) ? image_.substr(e.nameOffset, e.nameLength) : string_view();
+    };
+    uint32_t lo = 0, hi = h.count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (nameOf(entryAt(mid)) < name) lo = mid + 1;
+        else hi = mid;
+    }
+    // A definition that fails its checks is passed over for the next one
+    // with the same name
+    for (; lo < h.count; ++lo) {
+        Entry e = entryAt(lo);
+        if (nameOf(e) != name) break;
+        if (!inBounds(image_, e.offset, e.length) || fnv1a(image_.substr(e.offset, e.length)) != e.hash) continue;
+        json wf = json::from_cbor(image_.begin() + e.offset, image_.begin() + e.offset + e.length, true, false);
+        if (!wf.is_discarded()) return wf;
+    }
+    return nullopt;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "utils/json.hpp"
+#include "utils/MappedFile.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Compiled form of the workflow config, kept next to it as
+// <config>.cache and mapped read-only. The cache is reused while the
+// config's size and mtime match; if only the mtime moved, a matching
+// FNV-1a hash of the config still reuses it. Otherwise the config is parsed
+// once and the cache rewritten.
+//
+// Layout (native byte order): "FFCFG2\0\0", u64 config size, i64 config
+// mtime ns, u64 config hash, u32 workflow count, u32 globals offset, u32
+// globals length, u32 index offset; the index is one entry per workflow,
+// sorted by name and then config order (u32 name offset, u32 name length,
+// u32 definition offset, u32 definition length, u64 FNV-1a of the
+// definition). Definitions and the globals (every top-level key but
+// "workflows") are CBOR. Lookups skip a definition whose bounds, hash or
+// CBOR do not check out and try the next one of that name.
+class ConfigCache {
+public:
+    explicit ConfigCache(const std::string& configPath);
+
+    // False if the config is missing, malformed or has no "workflows" array
+    bool valid() const { return valid_; }
+    nlohmann::json globals() const;
+    // Definition of the first workflow with this name, parsed on demand
+    std::optional<nlohmann::json> find(std::string_view name) const;
+    size_t size() const;
+    // True if the cache file was used as is
+    bool hit() const { return hit_; }
+private:
+    bool build(const std::string& configPath, const std::string& cachePath);
+    bool check() const;
+
+    MappedFile file_;
+    std::string built_;      // image used when the cache could not be written
+    std::string_view image_;
+    bool valid_ = false;
+    bool hit_ = false;
+};
@@ -0,0 +1,147 @@
+#include "FileWatcher.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+#ifdef __linux__
+
+namespace {
+// Events that mean a file now exists with (new) contents
+constexpr uint32_t kWatchMask = IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE;
+}
+
+FileWatcher::FileWatcher() {
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotifyFd_ < 0 || epollFd_ < 0 || wakeFd_ < 0) {
+        string err = strerror(errno);
+        if (inotifyFd_ >= 0) close(inotifyFd_);
+        if (epollFd_ >= 0) close(epollFd_);
+        if (wakeFd_ >= 0) close(wakeFd_);
+        throw runtime_error("cannot set up file watcher: " + err);
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = inotifyFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, inotifyFd_, &ev);
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+}
+
+FileWatcher::~FileWatcher() {
+    stop();
+    close(inotifyFd_);
+    close(epollFd_);
+    close(wakeFd_);
+}
+
+void FileWatcher::watch(const string& path, chrono::milliseconds debounce, function<void()> fire) {
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    if (name.empty()) throw runtime_error("trigger path '" + path + "' names a directory");
+
+    int wd = inotify_add_watch(inotifyFd_, dir.c_str(), kWatchMask);
+    if (wd < 0) throw runtime_error("cannot watch '" + dir + "': " + strerror(errno));
+    triggers_.push_back({ name, debounce, std::move(fire), {}, false });
+    byWatch_[wd].push_back(triggers_.size() - 1);
+}
+
+void FileWatcher::start() {
+    thread_ = thread([this] { run(); });
+}
+
+void FileWatcher::stop() {
+    if (!thread_.joinable()) return;
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+    (void)ignored;
+    thread_.join();
+}
+
+void FileWatcher::touch(Trigger& trigger, Clock::time_point now) {
+    // Trailing-edge debounce: every event pushes the deadline out again
+    trigger.pending = true;
+    trigger.deadline = now + trigger.debounce;
+}
+
+void FileWatcher::drainEvents() {
+    alignas(inotify_event) char buf[4096];
+    Clock::time_point now = Clock::now();
+    while (true) {
+        ssize_t len = read(inotifyFd_, buf, sizeof(buf));
+        if (len <= 0) return;
+        for (char* p = buf; p < buf + len;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost; let every guard decide
+                for (auto& t : triggers_) touch(t, now);
+                continue;
+            }
+            auto it = byWatch_.find(event->wd);
+            if (it == byWatch_.end() || event->len == 0) continue;
+            for (size_t index : it->second) {
+                if (triggers_[index].name == event->name) touch(triggers_[index], now);
+            }
+        }
+    }
+}
+
+void FileWatcher::run() {
+    epoll_event events[4];
+    while (true) {
+        int timeout = -1;
+        Clock::time_point now = Clock::now();
+        for (const auto& t : triggers_) {
+            if (!t.pending) continue;
+            auto wait = chrono::ceil<chrono::milliseconds>(t.deadline - now).count();
+            wait = max<decltype(wait)>(wait, 0);
+            if (timeout < 0 || wait < timeout) timeout = static_cast<int>(wait);
+        }
+
+        int n = epoll_wait(epollFd_, events, 4, timeout);
+        if (n < 0 && errno != EINTR) return;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == wakeFd_) return;
+            drainEvents();
+        }
+
+        now = Clock::now();
+        for (auto& t : triggers_) {
+            if (t.pending && t.deadline <= now) {
+                t.pending = false;
+                try {
+                    t.fire();
+                } catch (const exception& e) {
+                    cerr << "FileWatcher: trigger for '" << t.name << "' failed: " << e.what() << "\n";
+                }
+            }
+        }
+    }
+}
+
+#else
+
+FileWatcher::FileWatcher() {
+    throw runtime_error("file triggers are only supported on Linux");
+}
+FileWatcher::~FileWatcher() = default;
+void FileWatcher::watch(const string&, chrono::milliseconds, function<void()>) {}
+void FileWatcher::start() {}
+void FileWatcher::stop() {}
+void FileWatcher::touch(Trigger&, Clock::time_point) {}
+void FileWatcher::drainEvents() {}
+void FileWatcher::run() {}
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Event-driven file triggers for daemon mode (Linux: inotify + epoll). The
+// parent directory of each path is watched, so a path may be registered
+// before the file exists. A burst of events on one path is debounced into a
+// single callback that fires once the path has been quiet for `debounce`.
+// Callbacks run on the watcher thread and should only hand work off.
+class FileWatcher {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Throws std::runtime_error if inotify/epoll are unavailable
+    FileWatcher();
+    ~FileWatcher();
+
+    // Must be called before start(); throws std::runtime_error if the
+    // parent directory cannot be watched
+    void watch(const std::string& path, std::chrono::milliseconds debounce, std::function<void()> fire);
+    void start();
+    void stop();
+    size_t size() const { return triggers_.size(); }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+private:
+    struct Trigger {
+        std::string name; // file name inside the watched directory
+        std::chrono::milliseconds debounce;
+        std::function<void()> fire;
+        Clock::time_point deadline;
+        bool pending = false;
+    };
+
+    void run();
+    void drainEvents();
+    void touch(Trigger& trigger, Clock::time_point now);
+
+    int inotifyFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::vector<Trigger> triggers_;
+    // inotify watch descriptor -> triggers living in that directory
+    std::unordered_map<int, std::vector<size_t>> byWatch_;
+    std::thread thread_;
+};
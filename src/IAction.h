@@ -1,7 +1,114 @@
 #pragma once
 #include <string>
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include "utils/json.hpp"
 class IAction {
 public:
     virtual void execute(const std::string& params) = 0;
     virtual ~IAction() = default;
 };
+
+// Read-only view over the params of a batch of executions
+class ParamsSpan {
+public:
+    class iterator {
+    public:
+        explicit iterator(const nlohmann::json* const* p) : p_(p) {}
+        const nlohmann::json& operator*() const { return **p_; }
+        iterator& operator++() { ++p_; return *this; }
+        bool operator!=(const iterator& other) const { return p_ != other.p_; }
+    private:
+        const nlohmann::json* const* p_;
+    };
+
+    ParamsSpan(const nlohmann::json* const* items, size_t count) : items_(items), count_(count) {}
+    size_t size() const { return count_; }
+    const nlohmann::json& operator[](size_t i) const { return *items_[i]; }
+    iterator begin() const { return iterator(items_); }
+    iterator end() const { return iterator(items_ + count_); }
+private:
+    const nlohmann::json* const* items_;
+    size_t count_;
+};
+
+// Second-generation action interface, exported as
+//   extern "C" IActionV2* create_action_v2();
+// Params are parsed once when the workflow config is loaded and handed over
+// as JSON, so plugins don't re-parse the same string on every execution.
+// Engine and plugin must be built against the same json.hpp.
+class IActionV2 : public IAction {
+public:
+    using IAction::execute;
+    virtual void execute(const nlohmann::json& params) = 0;
+
+    // Outcome of each item of a batch, in order; null means it succeeded
+    using BatchResults = std::vector<std::exception_ptr>;
+
+    // The engine coalesces queued executions of the same plugin into one
+    // call, possibly from several workflow runs. Override to share setup
+    // (sessions, connections) across the batch. `results` arrives sized to
+    // the batch and all null; record each failing item's exception in its
+    // own slot so only that action is reported as failed. The default runs
+    // each item in turn.
+    virtual void executeBatch(ParamsSpan batch, BatchResults& results) {
+        size_t i = 0;
+        for (const nlohmann::json& params : batch) {
+            try {
+                execute(params);
+            } catch (...) {
+                results[i] = std::current_exception();
+            }
+            ++i;
+        }
+    }
+
+    // Fallback for callers that only have the v1 string form
+    void execute(const std::string& params) override {
+        execute(parseParams(params));
+    }
+
+    // JSON text becomes structured params; anything else (e.g. a bare path)
+    // is passed through as a JSON string.
+    static nlohmann::json parseParams(const std::string& params) {
+        auto parsed = nlohmann::json::parse(params, nullptr, false);
+        if (parsed.is_discarded()) return nlohmann::json(params);
+        return parsed;
+    }
+};
+
+// Optional plugin export that tells the engine how instances may be managed:
+//   extern "C" ActionTraits action_traits();
+// A reusable action is kept in a per-type pool and handed to one execution at
+// a time, so it can hold connections or buffers across calls. It must stay
+// usable after execute() throws.
+struct ActionTraits {
+    bool reusable;
+    unsigned maxPooled; // idle instances to keep; 0 = engine default
+};
+
+// Engine services for plugins, passed through the optional export
+//   extern "C" void plugin_init(const HostServices* host);
+// which runs once after the plugin is loaded, before any create_action*.
+// The table, and everything it points to, stays valid until the plugin is
+// unloaded. Plain C so it does not depend on the engine's C++ ABI; fields
+// are only ever appended, check `version` before using newer ones.
+enum HostLogLevel { HOST_LOG_DEBUG = 0, HOST_LOG_INFO = 1, HOST_LOG_WARN = 2, HOST_LOG_ERROR = 3 };
+
+struct HostServices {
+    unsigned version; // HOST_SERVICES_VERSION of the engine
+    void* ctx;        // first argument of every call below
+    // One line in the engine log, tagged with the plugin's name. Lines
+    // below the plugin's configured level are dropped.
+    void (*log)(void* ctx, int level, const char* msg, size_t len);
+    // Whether a line at this level would be kept; lets plugins skip
+    // building expensive debug output
+    int (*log_enabled)(void* ctx, int level);
+    // Adds one sample to a named per-plugin metric, reported at exit
+    void (*metric)(void* ctx, const char* name, double value);
+    // Monotonic clock in nanoseconds
+    unsigned long long (*now_ns)(void* ctx);
+};
+
+#define HOST_SERVICES_VERSION 1u
@@ -0,0 +1,251 @@
+// flowforge-logdecode: turns logs/engine.bin (FLOWFORGE_LOG_FORMAT=binary)
+// back into text lines, or JSON lines with --json.
+#include "BinaryLogFormat.h"
+#include "Logger.h"
+#include "utils/json.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Site {
+    string format;
+    string file;
+    uint32_t line = 0;
+};
+
+struct Record {
+    uint64_t steadyNs;
+    uint32_t thread;
+    uint32_t site;
+    vector<LogArg> args;
+};
+
+// Bounds-checked little-endian reader over one frame
+class Reader {
+public:
+    Reader(const char* data, size_t size) : data_(data), size_(size) {}
+    template<class T>
+    T get() {
+        T value;
+        need(sizeof(T));
+        memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+    string_view bytes(size_t n) {
+        need(n);
+        string_view view(data_ + pos_, n);
+        pos_ += n;
+        return view;
+    }
+    bool done() const { return pos_ == size_; }
+private:
+    void need(size_t n) const {
+        if (size_ - pos_ < n) throw runtime_error("truncated record");
+    }
+    const char* data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+class Decoder {
+public:
+    explicit Decoder(bool json) : json_(json) {}
+
+    // Returns false on a malformed or truncated stream
+    bool run(istream& in) {
+        while (true) {
+            int kind = in.get();
+            if (kind == EOF) return true;
+            try {
+                if (kind == binlog::kMagic[0]) {
+                    readHeader(in);
+                } else if (kind == binlog::Site) {
+                    readSite(in);
+                } else if (kind == binlog::Clock) {
+                    clockStamp_ = readValue<uint64_t>(in);
+                    clockNs_ = readValue<uint64_t>(in);
+                } else if (kind == binlog::Batch) {
+                    readBatch(in);
+                } else {
+                    cerr << "flowforge-logdecode: unknown frame " << kind << " at offset "
+                         << (static_cast<long long>(in.tellg()) - 1) << "\n";
+                    return false;
+                }
+            } catch (const exception& e) {
+                cerr << "flowforge-logdecode: " << e.what() << "\n";
+                return false;
+            }
+        }
+    }
+
+private:
+    static void readExact(istream& in, char* out, size_t n) {
+        if (!in.read(out, static_cast<streamsize>(n))) throw runtime_error("unexpected end of file");
+    }
+
+    template<class T>
+    static T readValue(istream& in) {
+        T value;
+        readExact(in, reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    // Every process run appends its own header; site IDs restart with it
+    void readHeader(istream& in) {
+        char magic[sizeof(binlog::kMagic)];
+        magic[0] = binlog::kMagic[0];
+        readExact(in, magic + 1, sizeof(magic) - 1);
+        if (memcmp(magic, binlog::kMagic, sizeof(magic)) != 0) throw runtime_error("not a FlowForge binary log");
+        unit_ = static_cast<binlog::ClockUnit>(readValue<uint8_t>(in));
+        stampBase_ = readValue<uint64_t>(in);
+        steadyBase_ = readValue<uint64_t>(in);
+        systemBase_ = readValue<int64_t>(in);
+        clockStamp_ = stampBase_;
+        clockNs_ = steadyBase_;
+        sites_.clear();
+    }
+
+    void readSite(istream& in) {
+        uint32_t id = readValue<uint32_t>(in);
+        Site site;
+        site.line = readValue<uint32_t>(in);
+        site.file.resize(readValue<uint32_t>(in));
+        readExact(in, site.file.data(), site.file.size());
+        site.format.resize(readValue<uint32_t>(in));
+        readExact(in, site.format.data(), site.format.size());
+        sites_[id] = std::move(site);
+    }
+
+    void readBatch(istream& in) {
+        batch_.resize(readValue<uint32_t>(in));
+        readExact(in, batch_.data(), batch_.size());
+        Reader reader(batch_.data(), batch_.size());
+        records_.clear();
+        while (!reader.done()) {
+            Record record;
+            record.steadyNs = toSteadyNs(reader.get<uint64_t>());
+            record.thread = reader.get<uint32_t>();
+            record.site = reader.get<uint32_t>();
+            uint8_t count = reader.get<uint8_t>();
+            for (uint8_t i = 0; i < count; ++i) {
+                auto type = static_cast<LogArg::Type>(reader.get<uint8_t>());
+                if (type == LogArg::String) {
+                    record.args.emplace_back(reader.bytes(reader.get<uint32_t>()));
+                } else if (type <= LogArg::Double) {
+                    LogArg arg(uint64_t(0));
+                    arg.type = type;
+                    arg.u = reader.get<uint64_t>();
+                    record.args.push_back(arg);
+                } else {
+                    throw runtime_error("unknown argument type " + to_string(type));
+                }
+            }
+            records_.push_back(std::move(record));
+        }
+        stable_sort(records_.begin(), records_.end(), [](const Record& a, const Record& b) {
+            return a.steadyNs < b.steadyNs;
+        });
+        for (const Record& record : records_) print(record);
+    }
+
+    // TSC stamps are interpolated from the header and the latest sync point
+    uint64_t toSteadyNs(uint64_t stamp) const {
+        if (unit_ == binlog::SteadyNs) return stamp;
+        double nsPerTick = 1.0;
+        if (clockStamp_ > stampBase_) {
+            nsPerTick = static_cast<double>(clockNs_ - steadyBase_) / static_cast<double>(clockStamp_ - stampBase_);
+        }
+        double delta = (static_cast<double>(stamp) - static_cast<double>(clockStamp_)) * nsPerTick;
+        return static_cast<uint64_t>(static_cast<double>(clockNs_) + delta);
+    }
+
+    void print(const Record& record) {
+        auto site = sites_.find(record.site);
+        static const Site unknown{ "<unknown site {}>", "", 0 };
+        const Site& s = site != sites_.end() ? site->second : unknown;
+        string message = Logger::render(s.format, record.args.data(), record.args.size());
+        if (site == sites_.end()) message += " " + to_string(record.site);
+
+        int64_t wallNs = systemBase_ + static_cast<int64_t>(record.steadyNs - steadyBase_);
+        time_t seconds = static_cast<time_t>(wallNs / 1000000000);
+        tm local{};
+        localtime_r(&seconds, &local);
+        char stamp[64];
+        size_t n = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &local);
+        snprintf(stamp + n, sizeof(stamp) - n, ".%06lld", static_cast<long long>(wallNs % 1000000000 / 1000));
+
+        if (!json_) {
+            cout << stamp << " [" << threadName(record.thread) << "] " << message << "\n";
+            return;
+        }
+        nlohmann::json line;
+        line["time"] = stamp;
+        line["thread"] = threadName(record.thread);
+        if (!s.file.empty()) line["site"] = s.file + ":" + to_string(s.line);
+        line["format"] = s.format;
+        nlohmann::json args = nlohmann::json::array();
+        for (const LogArg& arg : record.args) {
+            switch (arg.type) {
+            case LogArg::Int: args.push_back(arg.i); break;
+            case LogArg::UInt: args.push_back(arg.u); break;
+            case LogArg::Double: args.push_back(arg.d); break;
+            case LogArg::String: args.push_back(string(arg.s)); break;
+            }
+        }
+        line["args"] = std::move(args);
+        line["message"] = message;
+        cout << line.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << "\n";
+    }
+
+    static string threadName(uint32_t thread) {
+        return thread == UINT32_MAX ? "logger" : "t" + to_string(thread);
+    }
+
+    bool json_;
+    binlog::ClockUnit unit_ = binlog::SteadyNs;
+    uint64_t stampBase_ = 0;
+    uint64_t steadyBase_ = 0;
+    uint64_t clockStamp_ = 0;
+    uint64_t clockNs_ = 0;
+    int64_t systemBase_ = 0;
+    unordered_map<uint32_t, Site> sites_;
+    string batch_;
+    vector<Record> records_;
+};
+
+}
+
+int main(int argc, char** argv) {
+    bool json = false;
+    string path = "logs/engine.bin";
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "-h" || arg == "--help") {
+            cout << "Usage: flowforge-logdecode [--json] [file]\n"
+                 << "Decodes a binary engine log (default logs/engine.bin) to text or JSON lines.\n";
+            return 0;
+        } else {
+            path = arg;
+        }
+    }
+    ios::sync_with_stdio(false);
+    if (path == "-") return Decoder(json).run(cin) ? 0 : 1;
+    ifstream in(path, ios::binary);
+    if (!in) {
+        cerr << "flowforge-logdecode: cannot open " << path << "\n";
+        return 1;
+    }
+    return Decoder(json).run(in) ? 0 : 1;
+}
@@ -1,9 +1,436 @@
 #include "Logger.h"
+#include "BinaryLogFormat.h"
+#include "RotatingFile.h"
 #include <iostream>
 #include <ctime>
 #include <filesystem>
+#include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <unistd.h>
 using namespace std;
+
+namespace {
+// Same "<ctime>: <msg>" layout in both modes; the ctime text is cached per
+// thread for the current second
+string formatLine(const string& msg) {
+    thread_local time_t cachedSecond = -1;
+    thread_local char stamp[32];
+    time_t now = time(nullptr);
+    if (now != cachedSecond) {
+        ctime_r(&now, stamp);
+        cachedSecond = now;
+    }
+    string line;
+    line.reserve(strlen(stamp) + msg.size() + 3);
+    line.append(stamp).append(": ").append(msg).push_back('\n');
+    return line;
+}
+
+void writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// What to do with a line when the async queue or a binary thread buffer is full
+enum class Overflow { Block, Drop, Count };
+
+Overflow overflowPolicy() {
+    const char* env = getenv("FLOWFORGE_LOG_OVERFLOW");
+    if (env && string(env) == "drop") return Overflow::Drop;
+    if (env && string(env) == "count") return Overflow::Count;
+    return Overflow::Block;
+}
+
+template<class T>
+void put(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+size_t envSize(const char* name, size_t fallback) {
+    const char* env = getenv(name);
+    if (!env) return fallback;
+    try {
+        return stoul(env);
+    } catch (...) {
+        cerr << "Ignoring invalid " << name << " value '" << env << "'\n";
+        return fallback;
+    }
+}
+}
+
+// Bounded MPSC queue (Vyukov's per-slot sequence scheme) plus the flusher
+// thread. Producers claim a slot with one CAS and move their preformatted
+// line in; only the flusher dequeues.
+struct Logger::Async {
+    struct Slot {
+        atomic<size_t> seq;
+        string file;    // full line for engine.log
+        size_t msgAt;   // offset of the part stdout gets (the size when none)
+    };
+
+    RotatingFile& file;
+    Overflow overflow = Overflow::Block;
+    chrono::milliseconds interval{100};
+    unique_ptr<Slot[]> ring;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> head{0};
+    alignas(64) size_t tail = 0;
+    atomic<uint64_t> dropped{0};
+    uint64_t reportedDrops = 0;
+    atomic<uint64_t> pushed{0};
+    atomic<uint64_t> written{0};
+
+    mutex mtx;
+    condition_variable wake;   // flusher: time to drain
+    condition_variable space;  // producers/flush(): something was drained
+    bool stop = false;
+    thread flusher;
+
+    Async(RotatingFile& file, size_t capacity) : file(file) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        ring.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) ring[i].seq.store(i, memory_order_relaxed);
+    }
+
+    bool tryPush(string& line, size_t msgAt) {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true) {
+            Slot& slot = ring[pos & mask];
+            size_t seq = slot.seq.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    slot.file = std::move(line);
+                    slot.msgAt = msgAt;
+                    slot.seq.store(pos + 1, memory_order_release);
+                    pushed.fetch_add(1, memory_order_relaxed);
+                    // Start draining early once half the ring has filled
+                    // since the last nudge instead of waiting out the interval
+                    if ((pos & (mask >> 1)) == 0) wake.notify_one();
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(string line, size_t msgAt) {
+        if (tryPush(line, msgAt)) return;
+        if (overflow != Overflow::Block) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        unique_lock<mutex> lock(mtx);
+        wake.notify_one();
+        while (!tryPush(line, msgAt)) {
+            space.wait_for(lock, chrono::milliseconds(10));
+        }
+    }
+
+    // Flusher thread only
+    size_t drain(string& fileBuf, string& outBuf) {
+        size_t count = 0;
+        while (true) {
+            Slot& slot = ring[tail & mask];
+            if (slot.seq.load(memory_order_acquire) != tail + 1) break;
+            fileBuf.append(slot.file);
+            outBuf.append(slot.file, slot.msgAt, string::npos);
+            slot.file.clear();
+            slot.seq.store(tail + mask + 1, memory_order_release);
+            ++tail;
+            ++count;
+        }
+        return count;
+    }
+
+    void run() {
+        string fileBuf, outBuf;
+        fileBuf.reserve(64 * 1024);
+        outBuf.reserve(64 * 1024);
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            bool stopping = stop;
+            lock.unlock();
+            size_t count = drain(fileBuf, outBuf);
+            uint64_t drops = dropped.load(memory_order_relaxed);
+            if (drops != reportedDrops && overflow == Overflow::Drop) {
+                string note = formatLine("Logger: dropped " + to_string(drops - reportedDrops) +
+                                         " log lines (queue full)");
+                fileBuf.append(note);
+                reportedDrops = drops;
+            }
+            if (!fileBuf.empty()) {
+                file.write(fileBuf);
+                writeAll(STDOUT_FILENO, outBuf.data(), outBuf.size());
+                fileBuf.clear();
+                outBuf.clear();
+            }
+            written.fetch_add(count, memory_order_release);
+            lock.lock();
+            space.notify_all();
+            if (stopping) break;
+            wake.wait_for(lock, interval);
+        }
+    }
+};
+
+// Binary sink. Each thread encodes records into its own fixed buffer under
+// an uncontended mutex; the flusher swaps the buffers out and writes them,
+// preceded by any newly registered sites, as one batch per interval.
+struct Logger::Binary {
+    struct ThreadBuffer {
+        explicit ThreadBuffer(size_t capacity)
+            : data(new char[capacity]), spare(new char[capacity]) {}
+        mutex mtx;
+        unique_ptr<char[]> data;
+        size_t size = 0;
+        unique_ptr<char[]> spare;   // flusher only
+        uint32_t thread = 0;
+    };
+
+    static constexpr size_t kMaxString = 64 * 1024;
+
+    RotatingFile& file;
+    bool tsc = false;
+    Overflow overflow = Overflow::Block;
+    chrono::milliseconds interval{100};
+    size_t capacity = 1 << 20;
+    atomic<uint64_t> dropped{0};
+    uint64_t reportedDrops = 0;
+
+    mutex mtx;
+    condition_variable wake;
+    condition_variable space;
+    vector<shared_ptr<ThreadBuffer>> buffers;
+    uint32_t nextThread = 0;
+    string pendingSites;
+    string header;
+    string sites;       // every site frame, repeated in each rotated segment
+    uint64_t started = 0;
+    uint64_t finished = 0;
+    bool stop = false;
+    thread flusher;
+
+    static uint64_t steadyNs() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The TSC is only usable as a clock when it ticks at a fixed rate
+    // through frequency and sleep state changes
+    static bool invariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        ifstream cpuinfo("/proc/cpuinfo");
+        string line;
+        while (getline(cpuinfo, line)) {
+            if (line.compare(0, 5, "flags") != 0) continue;
+            return line.find(" constant_tsc") != string::npos && line.find(" nonstop_tsc") != string::npos;
+        }
+#endif
+        return false;
+    }
+
+    uint64_t stamp() const {
+#if defined(__x86_64__) || defined(__i386__)
+        if (tsc) return __rdtsc();
+#endif
+        return steadyNs();
+    }
+
+    explicit Binary(RotatingFile& file) : file(file), tsc(invariantTsc()) {
+        // The clock anchor is taken once, so every segment's header carries
+        // the same long baseline for converting TSC stamps
+        header.assign(binlog::kMagic, sizeof(binlog::kMagic));
+        header.push_back(static_cast<char>(tsc ? binlog::Tsc : binlog::SteadyNs));
+        put<uint64_t>(header, stamp());
+        put<uint64_t>(header, steadyNs());
+        put<int64_t>(header, chrono::duration_cast<chrono::nanoseconds>(
+            chrono::system_clock::now().time_since_epoch()).count());
+        file.write(header);
+        addSite(binlog::kPlainSite, "{}", "", 0);
+        // A segment started by rotation must decode on its own
+        file.setPreamble([this] {
+            lock_guard<mutex> lock(mtx);
+            return header + sites;
+        });
+    }
+
+    // Caller holds mtx (or is the constructor)
+    void addSite(uint32_t id, string_view format, string_view source, int line) {
+        string frame(1, static_cast<char>(binlog::Site));
+        put<uint32_t>(frame, id);
+        put<uint32_t>(frame, static_cast<uint32_t>(line));
+        put<uint32_t>(frame, static_cast<uint32_t>(source.size()));
+        frame.append(source);
+        put<uint32_t>(frame, static_cast<uint32_t>(format.size()));
+        frame.append(format);
+        pendingSites.append(frame);
+        sites.append(frame);
+    }
+
+    ThreadBuffer& local() {
+        thread_local ThreadBuffer* cached = nullptr;
+        thread_local shared_ptr<ThreadBuffer> owner;
+        if (!cached) {
+            owner = make_shared<ThreadBuffer>(capacity);
+            lock_guard<mutex> lock(mtx);
+            owner->thread = nextThread++;
+            buffers.push_back(owner);
+            cached = owner.get();
+        }
+        return *cached;
+    }
+
+    static size_t encodedSize(const LogArg* args, size_t count) {
+        size_t size = 17;
+        for (size_t i = 0; i < count; ++i) {
+            size += args[i].type == LogArg::String ? 5 + min(args[i].s.size(), kMaxString) : 9;
+        }
+        return size;
+    }
+
+    static char* encode(char* out, uint64_t when, uint32_t thread, uint32_t site,
+                        const LogArg* args, size_t count) {
+        auto raw = [&out](const void* data, size_t size) {
+            memcpy(out, data, size);
+            out += size;
+        };
+        raw(&when, 8);
+        raw(&thread, 4);
+        raw(&site, 4);
+        *out++ = static_cast<char>(count);
+        for (size_t i = 0; i < count; ++i) {
+            const LogArg& arg = args[i];
+            *out++ = static_cast<char>(arg.type);
+            if (arg.type == LogArg::String) {
+                uint32_t length = static_cast<uint32_t>(min(arg.s.size(), kMaxString));
+                raw(&length, 4);
+                raw(arg.s.data(), length);
+            } else {
+                raw(&arg.u, 8);
+            }
+        }
+        return out;
+    }
+
+    void append(uint32_t site, const LogArg* args, size_t count) {
+        uint64_t when = stamp();
+        ThreadBuffer& buffer = local();
+        count = min<size_t>(count, 255);
+        size_t size = encodedSize(args, count);
+        if (size > capacity) {
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        while (true) {
+            {
+                lock_guard<mutex> lock(buffer.mtx);
+                size_t before = buffer.size;
+                if (before + size <= capacity) {
+                    encode(buffer.data.get() + before, when, buffer.thread, site, args, count);
+                    buffer.size = before + size;
+                    // Start draining early once half the buffer is used
+                    if (before < capacity / 2 && buffer.size >= capacity / 2) wake.notify_one();
+                    return;
+                }
+            }
+            if (overflow != Overflow::Block) {
+                dropped.fetch_add(1, memory_order_relaxed);
+                return;
+            }
+            unique_lock<mutex> lock(mtx);
+            wake.notify_one();
+            space.wait_for(lock, chrono::milliseconds(10));
+        }
+    }
+
+    void run() {
+        string out;
+        vector<shared_ptr<ThreadBuffer>> current;
+        unique_lock<mutex> lock(mtx);
+        while (true) {
+            bool stopping = stop;
+            ++started;
+            current = buffers;
+            lock.unlock();
+
+            // Records first, then the sites: every site a swapped-out record
+            // uses was registered before the swap, so it is pending by now
+            string batch;
+            for (auto& buffer : current) {
+                size_t size;
+                {
+                    lock_guard<mutex> bufferLock(buffer->mtx);
+                    buffer->data.swap(buffer->spare);
+                    size = buffer->size;
+                    buffer->size = 0;
+                }
+                batch.append(buffer->spare.get(), size);
+            }
+            uint64_t drops = dropped.load(memory_order_relaxed);
+            if (drops != reportedDrops && overflow == Overflow::Drop) {
+                string note = "Logger: dropped " + to_string(drops - reportedDrops) + " log lines (buffer full)";
+                LogArg arg(note);
+                size_t at = batch.size();
+                batch.resize(at + encodedSize(&arg, 1));
+                encode(&batch[at], stamp(), UINT32_MAX, binlog::kPlainSite, &arg, 1);
+                reportedDrops = drops;
+            }
+
+            lock.lock();
+            out.swap(pendingSites);
+            lock.unlock();
+            if (!batch.empty()) {
+                if (tsc) {
+                    // Sync point for converting this batch's TSC stamps
+                    out.push_back(static_cast<char>(binlog::Clock));
+                    put<uint64_t>(out, stamp());
+                    put<uint64_t>(out, steadyNs());
+                }
+                out.push_back(static_cast<char>(binlog::Batch));
+                put<uint32_t>(out, static_cast<uint32_t>(batch.size()));
+                out.append(batch);
+            }
+            if (!out.empty()) file.write(out);
+            out.clear();
+
+            lock.lock();
+            finished = started;
+            space.notify_all();
+            // Buffers of exited threads go once they are drained
+            current.clear();
+            buffers.erase(remove_if(buffers.begin(), buffers.end(), [](const shared_ptr<ThreadBuffer>& b) {
+                return b.use_count() == 1 && b->size == 0;
+            }), buffers.end());
+            if (stopping) break;
+            wake.wait_for(lock, interval);
+        }
+    }
+};
+
 Logger::Logger() {
     namespace fs = std::filesystem;
     const char* env = std::getenv("FLOWFORGE_LOG_DIR");
@@ -11,19 +438,141 @@ Logger::Logger() {
     try {
         fs::create_directories(logdir);
     } catch(...) {
-        // ignore - we'll attempt to open file and let ofstream report errors
+        // ignore - we'll attempt to open file and let RotatingFile report errors
     }
     fs::path logfile = logdir / "engine.log";
-    file_.open(logfile.string(), ios::app);
+    auto interval = chrono::milliseconds(max<size_t>(1, envSize("FLOWFORGE_LOG_FLUSH_MS", 100)));
+
+    const char* format = std::getenv("FLOWFORGE_LOG_FORMAT");
+    if (format && string(format) == "binary") {
+        file_ = make_unique<RotatingFile>((logdir / "engine.bin").string(), RotatingFile::Policy::fromEnvironment());
+        binary_ = make_unique<Binary>(*file_);
+        binary_->overflow = overflowPolicy();
+        binary_->interval = interval;
+        Binary* state = binary_.get();
+        binary_->flusher = thread([state] { state->run(); });
+        return;
+    }
+
+    file_ = make_unique<RotatingFile>(logfile.string(), RotatingFile::Policy::fromEnvironment());
+    const char* mode = std::getenv("FLOWFORGE_LOG_MODE");
+    if (mode && string(mode) == "async") {
+        async_ = make_unique<Async>(*file_, envSize("FLOWFORGE_LOG_QUEUE", 8192));
+        async_->overflow = overflowPolicy();
+        async_->interval = interval;
+        Async* state = async_.get();
+        async_->flusher = thread([state] { state->run(); });
+        return;
+    }
 }
+
+Logger::~Logger() {
+    if (binary_) {
+        {
+            lock_guard<mutex> lock(binary_->mtx);
+            binary_->stop = true;
+        }
+        binary_->wake.notify_one();
+        binary_->flusher.join();
+    }
+    if (!async_) return;
+    {
+        lock_guard<mutex> lock(async_->mtx);
+        async_->stop = true;
+    }
+    async_->wake.notify_one();
+    async_->flusher.join();
+}
+
 Logger& Logger::instance() {
     static Logger inst;
     return inst;
 }
+
+LogSite::LogSite(const char* format, const char* file, int line)
+    : format(format), file(file), line(line), id(Logger::instance().registerSite(*this)) {}
+
+uint32_t Logger::registerSite(const LogSite& site) {
+    static atomic<uint32_t> nextId{binlog::kPlainSite + 1};
+    uint32_t id = nextId.fetch_add(1, memory_order_relaxed);
+    if (binary_) {
+        lock_guard<mutex> lock(binary_->mtx);
+        binary_->addSite(id, site.format, site.file, site.line);
+    }
+    return id;
+}
+
+string Logger::render(string_view format, const LogArg* args, size_t count) {
+    string out;
+    out.reserve(format.size() + 16 * count);
+    size_t next = 0;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && next < count) {
+            const LogArg& arg = args[next++];
+            switch (arg.type) {
+            case LogArg::Int: out += to_string(arg.i); break;
+            case LogArg::UInt: out += to_string(arg.u); break;
+            case LogArg::Double: {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%g", arg.d);
+                out += buf;
+                break;
+            }
+            case LogArg::String: out.append(arg.s); break;
+            }
+            ++i;
+        } else {
+            out.push_back(format[i]);
+        }
+    }
+    return out;
+}
+
+void Logger::write(const LogSite& site, const LogArg* args, size_t count, bool echo) {
+    if (binary_) {
+        binary_->append(site.id, args, count);
+        return;
+    }
+    logLine(render(site.format, args, count), echo);
+}
+
 void Logger::log(const string& msg) {
+    logLine(msg, true);
+}
+
+void Logger::logLine(const string& msg, bool echo) {
+    if (binary_) {
+        LogArg arg(msg);
+        binary_->append(binlog::kPlainSite, &arg, 1);
+        return;
+    }
+    if (async_) {
+        string line = formatLine(msg);
+        size_t msgAt = echo ? line.size() - msg.size() - 1 : line.size();
+        async_->push(std::move(line), msgAt);
+        return;
+    }
     lock_guard<mutex> lock(mtx_);
-    time_t now = time(nullptr);
-    file_ << std::ctime(&now) << ": " << msg << endl;
-    file_.flush();
-    cout << msg << endl;
+    file_->write(formatLine(msg));
+    if (echo) cout << msg << endl;
+}
+
+void Logger::flush() {
+    if (binary_) {
+        unique_lock<mutex> lock(binary_->mtx);
+        uint64_t target = binary_->started + 1;
+        binary_->wake.notify_one();
+        binary_->space.wait(lock, [&] { return binary_->finished >= target; });
+        return;
+    }
+    if (!async_) return;
+    uint64_t target = async_->pushed.load(memory_order_acquire);
+    unique_lock<mutex> lock(async_->mtx);
+    async_->wake.notify_one();
+    async_->space.wait(lock, [&] { return async_->written.load(memory_order_acquire) >= target; });
+}
+
+uint64_t Logger::dropped() const {
+    if (binary_) return binary_->dropped.load(memory_order_relaxed);
+    return async_ ? async_->dropped.load(memory_order_relaxed) : 0;
 }
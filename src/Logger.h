@@ -1,13 +1,101 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <mutex>
-#include <fstream>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+
+// Static call site of a structured log line. Registered once (the macro
+// below keeps it in a function-local static) and referenced by ID.
+struct LogSite {
+    LogSite(const char* format, const char* file, int line);
+    const char* format;
+    const char* file;
+    int line;
+    uint32_t id;
+};
+
+// One argument of a structured log line, captured without formatting
+struct LogArg {
+    enum Type : uint8_t { Int, UInt, Double, String };
+    Type type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+    std::string_view s;
+
+    template<class T, std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+    LogArg(T v) : type(Int), i(v) {}
+    template<class T, std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>, int> = 0>
+    LogArg(T v) : type(UInt), u(v) {}
+    LogArg(bool v) : type(String), u(0), s(v ? "true" : "false") {}
+    LogArg(double v) : type(Double), d(v) {}
+    LogArg(const char* v) : type(String), u(0), s(v) {}
+    LogArg(std::string_view v) : type(String), u(0), s(v) {}
+    LogArg(const std::string& v) : type(String), u(0), s(v) {}
+};
+
+class RotatingFile;
+
+// Engine log: every line goes to logs/engine.log and stdout.
+//
+// FLOWFORGE_LOG_MODE=async hands lines to a bounded lock-free queue that a
+// background thread drains into large write(2) calls every
+// FLOWFORGE_LOG_FLUSH_MS (default 100). When the queue is full,
+// FLOWFORGE_LOG_OVERFLOW=block (default) makes callers wait for space,
+// =drop discards the line and notes the loss in the log, and =count
+// discards it silently; dropped() reports the total. The default mode
+// writes and flushes each line synchronously.
+//
+// FLOWFORGE_LOG_FORMAT=binary replaces both with logs/engine.bin: each
+// FLOWFORGE_LOG call appends its site ID, raw arguments and a TSC or
+// steady-clock stamp (see BinaryLogFormat.h) to a per-thread buffer, and
+// nothing is formatted until flowforge-logdecode reads the file back. Nothing is echoed to stdout.
+//
+// Either file rotates as configured by RotatingFile::Policy::fromEnvironment.
 class Logger {
 public:
     static Logger& instance();
     void log(const std::string& msg);
+    // Structured line; "{}" in the site's format is replaced by each
+    // argument in turn. Use through FLOWFORGE_LOG.
+    template<class... Args>
+    void log(const LogSite& site, const Args&... args) {
+        const LogArg argv[] = { LogArg(args)..., LogArg(0) };
+        write(site, argv, sizeof...(Args), true);
+    }
+    // Like log(site, ...) but the line only goes to the log file
+    template<class... Args>
+    void record(const LogSite& site, const Args&... args) {
+        const LogArg argv[] = { LogArg(args)..., LogArg(0) };
+        write(site, argv, sizeof...(Args), false);
+    }
+    // Blocks until every line logged so far has been written (async and
+    // binary modes)
+    void flush();
+    uint64_t dropped() const;
+    // Expands a structured line the way text mode writes it
+    static std::string render(std::string_view format, const LogArg* args, size_t count);
+    ~Logger();
 private:
+    friend struct LogSite;
     Logger();
+    void write(const LogSite& site, const LogArg* args, size_t count, bool echo);
+    void logLine(const std::string& msg, bool echo);
+    uint32_t registerSite(const LogSite& site);
+    struct Async;
+    struct Binary;
     std::mutex mtx_;
-    std::ofstream file_;
+    std::unique_ptr<RotatingFile> file_;
+    std::unique_ptr<Async> async_;
+    std::unique_ptr<Binary> binary_;
 };
+
+#define FLOWFORGE_LOG(format, ...)                                              \
+    do {                                                                        \
+        static const LogSite flowforgeLogSite_(format, __FILE__, __LINE__);     \
+        Logger::instance().log(flowforgeLogSite_, ##__VA_ARGS__);               \
+    } while (0)
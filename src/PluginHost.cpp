@@ -0,0 +1,124 @@
+#include "PluginHost.h"
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+namespace {
+// "off" sorts above every real level, so nothing passes it
+constexpr int kLevelOff = HOST_LOG_ERROR + 1;
+
+int parseLevel(const string& name) {
+    if (name == "debug") return HOST_LOG_DEBUG;
+    if (name == "info") return HOST_LOG_INFO;
+    if (name == "warn") return HOST_LOG_WARN;
+    if (name == "error") return HOST_LOG_ERROR;
+    if (name == "off") return kLevelOff;
+    return -1;
+}
+
+const char* levelName(int level) {
+    switch (level) {
+        case HOST_LOG_DEBUG: return "DEBUG";
+        case HOST_LOG_INFO: return "INFO";
+        case HOST_LOG_WARN: return "WARN";
+        default: return "ERROR";
+    }
+}
+}
+
+struct PluginHost::Channel {
+    string tag;
+    int level;
+    HostServices services;
+    mutex metricsMtx;
+    unordered_map<string, Metric> metrics;
+};
+
+PluginHost::PluginHost() {
+    // Plugins may log until they are unloaded, so the Logger has to be
+    // constructed first and therefore destroyed after the plugin registry
+    Logger::instance();
+
+    const char* env = getenv("FLOWFORGE_PLUGIN_LOG");
+    if (!env) return;
+    stringstream ss(env);
+    string item;
+    while (getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        int level = eq == string::npos ? -1 : parseLevel(item.substr(eq + 1));
+        if (level < 0) {
+            cerr << "Ignoring invalid FLOWFORGE_PLUGIN_LOG entry '" << item << "'\n";
+            continue;
+        }
+        string tag = item.substr(0, eq);
+        if (tag == "*") defaultLevel_ = level;
+        else levels_[tag] = level;
+    }
+}
+
+PluginHost::~PluginHost() = default;
+
+int PluginHost::levelFor(const string& tag) const {
+    auto it = levels_.find(tag);
+    return it != levels_.end() ? it->second : defaultLevel_;
+}
+
+const HostServices* PluginHost::servicesFor(const string& tag) {
+    lock_guard<mutex> lock(mtx_);
+    auto& channel = channels_[tag];
+    if (!channel) {
+        channel = make_unique<Channel>();
+        channel->tag = tag;
+        channel->level = levelFor(tag);
+        channel->services = HostServices{ HOST_SERVICES_VERSION, channel.get(), &PluginHost::log,
+                                          &PluginHost::logEnabled, &PluginHost::metric, &PluginHost::nowNs };
+    }
+    return &channel->services;
+}
+
+void PluginHost::log(void* ctx, int level, const char* msg, size_t len) {
+    auto* channel = static_cast<Channel*>(ctx);
+    if (level < channel->level) return;
+    static const LogSite site("[{}] {}: {}", __FILE__, __LINE__);
+    Logger::instance().record(site, channel->tag, levelName(level), string_view(msg, len));
+}
+
+int PluginHost::logEnabled(void* ctx, int level) {
+    return level >= static_cast<Channel*>(ctx)->level;
+}
+
+void PluginHost::metric(void* ctx, const char* name, double value) {
+    auto* channel = static_cast<Channel*>(ctx);
+    lock_guard<mutex> lock(channel->metricsMtx);
+    auto it = channel->metrics.find(name);
+    if (it == channel->metrics.end()) {
+        channel->metrics.emplace(name, Metric{ channel->tag, name, 1, value, value, value });
+        return;
+    }
+    Metric& m = it->second;
+    ++m.count;
+    m.sum += value;
+    m.min = min(m.min, value);
+    m.max = max(m.max, value);
+}
+
+unsigned long long PluginHost::nowNs(void*) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+vector<PluginHost::Metric> PluginHost::metrics() const {
+    vector<Metric> result;
+    lock_guard<mutex> lock(mtx_);
+    for (const auto& entry : channels_) {
+        lock_guard<mutex> metricsLock(entry.second->metricsMtx);
+        for (const auto& m : entry.second->metrics) result.push_back(m.second);
+    }
+    sort(result.begin(), result.end(), [](const Metric& a, const Metric& b) {
+        return a.plugin != b.plugin ? a.plugin < b.plugin : a.name < b.name;
+    });
+    return result;
+}
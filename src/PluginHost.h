@@ -0,0 +1,47 @@
+#pragma once
+#include "IAction.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Engine side of HostServices. Each plugin gets its own channel, tagged with
+// the plugin's action type; its lines go through Logger (file only, not
+// echoed to stdout) and its metrics are aggregated here.
+//
+// FLOWFORGE_PLUGIN_LOG sets per-plugin levels, e.g.
+// "EmailPlugin=debug,MessagePlugin=off,*=warn"; the default is info.
+class PluginHost {
+public:
+    struct Metric {
+        std::string plugin;
+        std::string name;
+        uint64_t count;
+        double sum;
+        double min;
+        double max;
+    };
+
+    PluginHost();
+    ~PluginHost();
+    // Table for one plugin; stable for the host's lifetime
+    const HostServices* servicesFor(const std::string& tag);
+    std::vector<Metric> metrics() const;
+
+    PluginHost(const PluginHost&) = delete;
+    PluginHost& operator=(const PluginHost&) = delete;
+private:
+    struct Channel;
+    static void log(void* ctx, int level, const char* msg, size_t len);
+    static int logEnabled(void* ctx, int level);
+    static void metric(void* ctx, const char* name, double value);
+    static unsigned long long nowNs(void* ctx);
+    int levelFor(const std::string& tag) const;
+
+    std::unordered_map<std::string, int> levels_;
+    int defaultLevel_ = HOST_LOG_INFO;
+    mutable std::mutex mtx_;
+    std::unordered_map<std::string, std::unique_ptr<Channel>> channels_;
+};
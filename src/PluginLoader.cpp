@@ -3,9 +3,119 @@
 #include <stdexcept>
 #include <vector>
 #include <string>
+#include <mutex>
+#include <thread>
+#include <algorithm>
 using namespace std;
-typedef IAction* (*CreateActionFunc)();
+
+PluginLoader& PluginLoader::instance() {
+    static PluginLoader inst;
+    return inst;
+}
+
+PluginLoader::~PluginLoader() {
+    for (auto& entry : plugins_) {
+        // Pooled instances run code from the library, drop them first
+        entry.second->idle.clear();
+        if (entry.second->handle) dlclose(entry.second->handle);
+    }
+}
+
 unique_ptr<IAction> PluginLoader::load(const string& pluginPath) {
+    Plugin& plugin = resolve(pluginPath);
+    return unique_ptr<IAction>(plugin.instantiate());
+}
+
+PluginLoader::Lease PluginLoader::acquire(const string& pluginPath) {
+    Plugin& plugin = resolve(pluginPath);
+    if (plugin.traits.reusable) {
+        lock_guard<mutex> lock(plugin.poolMtx);
+        if (!plugin.idle.empty()) {
+            IAction* action = plugin.idle.back().release();
+            plugin.idle.pop_back();
+            reused_.fetch_add(1, memory_order_relaxed);
+            return Lease(&plugin, action);
+        }
+    }
+    return Lease(&plugin, plugin.instantiate());
+}
+
+PluginLoader::Info PluginLoader::info(const string& pluginPath) {
+    Plugin& plugin = resolve(pluginPath);
+    return Info{ plugin.createV2 != nullptr, plugin.traits };
+}
+
+size_t PluginLoader::defaultPoolLimit() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+PluginLoader::Stats PluginLoader::stats() const {
+    return Stats{ hits_.load(memory_order_relaxed), misses_.load(memory_order_relaxed),
+                  reused_.load(memory_order_relaxed) };
+}
+
+PluginLoader::Plugin& PluginLoader::resolve(const string& pluginPath) {
+    {
+        shared_lock<shared_mutex> lock(mtx_);
+        auto it = plugins_.find(pluginPath);
+        if (it != plugins_.end()) {
+            hits_.fetch_add(1, memory_order_relaxed);
+            return *it->second;
+        }
+    }
+
+    // Probe the filesystem without holding the lock so that different plugins
+    // can be resolved in parallel. If two threads race on the same path the
+    // loser just drops its extra dlopen reference.
+    misses_.fetch_add(1, memory_order_relaxed);
+    unique_ptr<Plugin> plugin = open(pluginPath);
+
+    unique_lock<shared_mutex> lock(mtx_);
+    auto inserted = plugins_.emplace(pluginPath, nullptr);
+    if (inserted.second) {
+        inserted.first->second = std::move(plugin);
+    } else {
+        dlclose(plugin->handle);
+    }
+    return *inserted.first->second;
+}
+
+IActionV2* PluginLoader::Lease::v2() const {
+    return plugin_->createV2 ? static_cast<IActionV2*>(action_) : nullptr;
+}
+
+PluginLoader::Lease::Lease(Lease&& other) noexcept : plugin_(other.plugin_), action_(other.action_) {
+    other.action_ = nullptr;
+}
+
+PluginLoader::Lease& PluginLoader::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        plugin_ = other.plugin_;
+        action_ = other.action_;
+        other.action_ = nullptr;
+    }
+    return *this;
+}
+
+PluginLoader::Lease::~Lease() {
+    release();
+}
+
+void PluginLoader::Lease::release() {
+    if (!action_) return;
+    unique_ptr<IAction> action(action_);
+    action_ = nullptr;
+    if (!plugin_->traits.reusable) return;
+
+    size_t limit = plugin_->traits.maxPooled ? plugin_->traits.maxPooled : defaultPoolLimit();
+    lock_guard<mutex> lock(plugin_->poolMtx);
+    if (plugin_->idle.size() < limit) {
+        plugin_->idle.push_back(std::move(action));
+    }
+}
+
+unique_ptr<PluginLoader::Plugin> PluginLoader::open(const string& pluginPath) {
     // Try a variety of likely paths so plugins can be found whether
     // running from repo root or build directory, and handle lib prefix/suffix variations.
     vector<string> candidates;
@@ -40,8 +150,11 @@ unique_ptr<IAction> PluginLoader::load(const string& pluginPath) {
             }
             continue;
         }
+        // v2 plugins may still export create_action for older engines; the
+        // v2 entry point wins when both are present.
         auto create = (CreateActionFunc)dlsym(handle, "create_action");
-        if (!create) {
+        auto createV2 = (CreateActionV2Func)dlsym(handle, "create_action_v2");
+        if (!create && !createV2) {
             const char* err = dlerror();
             dlclose(handle);
             if (err) {
@@ -49,7 +162,20 @@ unique_ptr<IAction> PluginLoader::load(const string& pluginPath) {
             }
             continue;
         }
-        return unique_ptr<IAction>(create());
+        auto plugin = make_unique<Plugin>();
+        plugin->handle = handle;
+        plugin->create = create;
+        plugin->createV2 = createV2;
+        auto traits = (ActionTraitsFunc)dlsym(handle, "action_traits");
+        if (traits) plugin->traits = traits();
+        // Logs and metrics are tagged with the action type: plugins/libEmailPlugin.so -> EmailPlugin
+        auto init = (PluginInitFunc)dlsym(handle, "plugin_init");
+        if (init) {
+            string tag = base.rfind("lib", 0) == 0 ? base.substr(3) : base;
+            tag = tag.substr(0, tag.find('.'));
+            init(host_.servicesFor(tag));
+        }
+        return plugin;
     }
 
     throw runtime_error(string("Failed to load plugin '") + pluginPath + "'. Tried candidates:\n" + lastErrors);
@@ -1,8 +1,91 @@
 #pragma once
 #include "IAction.h"
+#include "PluginHost.h"
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide plugin registry. Each plugin path is resolved (dlopen + dlsym)
+// once; later loads reuse the cached create_action symbol and only pay for
+// the hash lookup. Handles stay open until the registry is destroyed.
 class PluginLoader {
+    struct Plugin;
 public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t reused;
+    };
+
+    // Exclusive use of an action instance for one execution. Instances of
+    // reusable plugins go back to their pool when the lease ends.
+    class Lease {
+    public:
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+        IAction* operator->() const { return action_; }
+        IAction& operator*() const { return *action_; }
+        // Non-null when the plugin was created through create_action_v2
+        IActionV2* v2() const;
+    private:
+        friend class PluginLoader;
+        Lease(Plugin* plugin, IAction* action) : plugin_(plugin), action_(action) {}
+        void release();
+        Plugin* plugin_;
+        IAction* action_;
+    };
+
+    struct Info {
+        bool v2;
+        ActionTraits traits;
+    };
+
+    static PluginLoader& instance();
     std::unique_ptr<IAction> load(const std::string& pluginPath);
+    Lease acquire(const std::string& pluginPath);
+    Info info(const std::string& pluginPath);
+    // Idle instances kept per reusable plugin when traits leave it open
+    static size_t defaultPoolLimit();
+    Stats stats() const;
+    const PluginHost& host() const { return host_; }
+    ~PluginLoader();
+
+    PluginLoader(const PluginLoader&) = delete;
+    PluginLoader& operator=(const PluginLoader&) = delete;
+private:
+    typedef IAction* (*CreateActionFunc)();
+    typedef IActionV2* (*CreateActionV2Func)();
+    typedef ActionTraits (*ActionTraitsFunc)();
+    typedef void (*PluginInitFunc)(const HostServices*);
+    struct Plugin {
+        void* handle = nullptr;
+        CreateActionFunc create = nullptr;
+        CreateActionV2Func createV2 = nullptr;
+        ActionTraits traits{ false, 0 };
+        std::mutex poolMtx;
+        std::vector<std::unique_ptr<IAction>> idle;
+
+        IAction* instantiate() const {
+            if (createV2) return createV2();
+            return create();
+        }
+    };
+
+    PluginLoader() = default;
+    Plugin& resolve(const std::string& pluginPath);
+    std::unique_ptr<Plugin> open(const std::string& pluginPath);
+
+    // Declared first so it outlives the plugins unloaded by the destructor
+    PluginHost host_;
+    mutable std::shared_mutex mtx_;
+    std::unordered_map<std::string, std::unique_ptr<Plugin>> plugins_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> reused_{0};
 };
@@ -0,0 +1,208 @@
+#include "RotatingFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+using namespace std;
+namespace fs = std::filesystem;
+
+RotatingFile::Policy RotatingFile::Policy::fromEnvironment() {
+    Policy policy;
+    auto number = [](const char* name, uint64_t fallback) -> uint64_t {
+        const char* env = getenv(name);
+        if (!env) return fallback;
+        try {
+            return stoull(env);
+        } catch (...) {
+            cerr << "Ignoring invalid " << name << " value '" << env << "'\n";
+            return fallback;
+        }
+    };
+    policy.maxBytes = number("FLOWFORGE_LOG_ROTATE_MB", 0) * 1024 * 1024;
+    policy.keep = static_cast<size_t>(number("FLOWFORGE_LOG_KEEP", policy.keep));
+    policy.compress = number("FLOWFORGE_LOG_COMPRESS", 1) != 0;
+    if (const char* at = getenv("FLOWFORGE_LOG_ROTATE_AT")) {
+        try {
+            policy.schedule = Schedule::parse(at);
+        } catch (const exception& e) {
+            // Parse also rejects schedules that never fire; size-based
+            // rotation still applies
+            cerr << "Ignoring invalid FLOWFORGE_LOG_ROTATE_AT (" << e.what()
+                 << "); logs will not rotate on a schedule\n";
+        }
+    }
+    return policy;
+}
+
+RotatingFile::RotatingFile(string path, Policy policy)
+    : path_(std::move(path)), policy_(std::move(policy)) {
+    open();
+    planRoll(Schedule::Clock::now());
+}
+
+RotatingFile::~RotatingFile() {
+    if (archiver_.joinable()) {
+        {
+            lock_guard<mutex> lock(archiveMtx_);
+            stopArchiver_ = true;
+        }
+        archiveCv_.notify_one();
+        archiver_.join();
+    }
+    if (fd_ >= 0) ::close(fd_);
+}
+
+void RotatingFile::setPreamble(function<string()> preamble) {
+    lock_guard<mutex> lock(mtx_);
+    preamble_ = std::move(preamble);
+}
+
+// Leaves nextRoll_ at max() when there is nothing left to wait for
+void RotatingFile::planRoll(Schedule::Clock::time_point after) {
+    nextRoll_ = Schedule::Clock::time_point::max();
+    if (!policy_.schedule) return;
+    try {
+        nextRoll_ = policy_.schedule->next(after);
+    } catch (const exception& e) {
+        cerr << "Log " << path_ << " stops rotating on a schedule: " << e.what() << "\n";
+    }
+}
+
+void RotatingFile::open() {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        cerr << "Cannot open log file " << path_ << ": " << strerror(errno) << "\n";
+        size_ = 0;
+        return;
+    }
+    struct stat st;
+    size_ = fstat(fd_, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+void RotatingFile::write(const char* data, size_t size) {
+    lock_guard<mutex> lock(mtx_);
+    if (size_ > 0) {
+        bool full = policy_.maxBytes > 0 && size_ + size > policy_.maxBytes;
+        bool due = false;
+        Schedule::Clock::time_point now{};
+        if (policy_.schedule) {
+            now = Schedule::Clock::now();
+            due = now >= nextRoll_;
+        }
+        if (full || due) rotate(due ? now : Schedule::Clock::now());
+    }
+    if (fd_ < 0) return;
+    while (size > 0) {
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+        size_ += static_cast<uint64_t>(n);
+    }
+}
+
+// Caller holds mtx_
+void RotatingFile::rotate(Schedule::Clock::time_point now) {
+    planRoll(now);
+
+    // <path>.<yyyymmdd-HHMMSS>.<n> sorts oldest first, which prune() relies on
+    time_t t = Schedule::Clock::to_time_t(now);
+    tm local{};
+    localtime_r(&t, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    sameStamp_ = lastStamp_ == stamp ? sameStamp_ + 1 : 0;
+    lastStamp_ = stamp;
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%03u", sameStamp_);
+    string segment = path_ + "." + stamp + suffix;
+
+    if (fd_ >= 0) ::close(fd_);
+    if (::rename(path_.c_str(), segment.c_str()) != 0) {
+        cerr << "Cannot rotate " << path_ << ": " << strerror(errno) << "\n";
+        segment.clear();
+    }
+    open();
+    if (fd_ >= 0 && preamble_) {
+        string head = preamble_();
+        if (::write(fd_, head.data(), head.size()) == static_cast<ssize_t>(head.size())) size_ += head.size();
+    }
+    if (segment.empty()) return;
+
+    lock_guard<mutex> lock(archiveMtx_);
+    toArchive_.push_back(std::move(segment));
+    if (!archiver_.joinable()) archiver_ = thread([this] { runArchiver(); });
+    archiveCv_.notify_one();
+}
+
+void RotatingFile::runArchiver() {
+    unique_lock<mutex> lock(archiveMtx_);
+    while (true) {
+        archiveCv_.wait(lock, [this] { return stopArchiver_ || !toArchive_.empty(); });
+        if (toArchive_.empty()) return;
+        string segment = std::move(toArchive_.front());
+        toArchive_.pop_front();
+        lock.unlock();
+        if (policy_.compress) archive(segment);
+        prune();
+        lock.lock();
+    }
+}
+
+// gzip the segment next to itself; the raw file stays if anything fails
+void RotatingFile::archive(const string& segment) {
+    string target = segment + ".gz";
+    string tmp = target + ".tmp";
+    FILE* in = fopen(segment.c_str(), "rb");
+    if (!in) return;
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    bool ok = out != nullptr;
+    vector<char> buf(64 * 1024);
+    while (ok) {
+        size_t n = fread(buf.data(), 1, buf.size(), in);
+        if (n == 0) {
+            ok = !ferror(in);
+            break;
+        }
+        ok = gzwrite(out, buf.data(), static_cast<unsigned>(n)) == static_cast<int>(n);
+    }
+    fclose(in);
+    if (out && gzclose(out) != Z_OK) ok = false;
+    if (ok && ::rename(tmp.c_str(), target.c_str()) == 0) {
+        ::unlink(segment.c_str());
+    } else {
+        cerr << "Cannot compress rotated log " << segment << "\n";
+        ::unlink(tmp.c_str());
+    }
+}
+
+void RotatingFile::prune() {
+    fs::path base(path_);
+    fs::path dir = base.has_parent_path() ? base.parent_path() : fs::path(".");
+    string prefix = base.filename().string() + ".";
+    vector<string> segments;
+    error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        string name = entry.path().filename().string();
+        if (name.compare(0, prefix.size(), prefix) != 0) continue;
+        if (name.size() >= 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) continue;
+        segments.push_back(name);
+    }
+    if (segments.size() <= policy_.keep) return;
+    sort(segments.begin(), segments.end());
+    for (size_t i = 0; i + policy_.keep < segments.size(); ++i) {
+        fs::remove(dir / segments[i], ec);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Schedule.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+// Append-only log file that rolls over by size and/or on a schedule. A
+// rolled segment is renamed to <path>.<yyyymmdd-HHMMSS>.<n> and, on a
+// background thread, gzip-compressed and pruned to the newest `keep`
+// segments, so writers only ever pay for a rename and an open.
+class RotatingFile {
+public:
+    struct Policy {
+        uint64_t maxBytes = 0;            // 0: no size limit
+        std::optional<Schedule> schedule; // roll whenever it fires
+        size_t keep = 7;
+        bool compress = true;
+
+        // FLOWFORGE_LOG_ROTATE_MB, FLOWFORGE_LOG_ROTATE_AT (a schedule such
+        // as "@daily" or "@every 6h"), FLOWFORGE_LOG_KEEP and
+        // FLOWFORGE_LOG_COMPRESS=0. No rotation when neither trigger is set.
+        static Policy fromEnvironment();
+    };
+
+    RotatingFile(std::string path, Policy policy);
+    // Waits for pending compression
+    ~RotatingFile();
+
+    // Bytes written at the start of each segment that rotation creates,
+    // for formats that need a header
+    void setPreamble(std::function<std::string()> preamble);
+    // Writes are never split across segments. Safe to call concurrently.
+    void write(const char* data, size_t size);
+    void write(const std::string& data) { write(data.data(), data.size()); }
+    bool isOpen() const { return fd_ >= 0; }
+    const std::string& path() const { return path_; }
+
+    RotatingFile(const RotatingFile&) = delete;
+    RotatingFile& operator=(const RotatingFile&) = delete;
+private:
+    void open();
+    void rotate(Schedule::Clock::time_point now);
+    void planRoll(Schedule::Clock::time_point after);
+    void archive(const std::string& segment);
+    void prune();
+    void runArchiver();
+
+    const std::string path_;
+    const Policy policy_;
+    std::mutex mtx_;
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    Schedule::Clock::time_point nextRoll_ = Schedule::Clock::time_point::max();
+    std::function<std::string()> preamble_;
+    std::string lastStamp_;
+    unsigned sameStamp_ = 0;
+
+    std::mutex archiveMtx_;
+    std::condition_variable archiveCv_;
+    std::deque<std::string> toArchive_;
+    bool stopArchiver_ = false;
+    std::thread archiver_;
+};
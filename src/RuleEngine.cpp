@@ -1,150 +1,481 @@
 #include "RuleEngine.h"
-#include <sys/statvfs.h>
+#include "SystemMetrics.h"
 #include <unistd.h>
 #include <ctime>
 #include <regex>
-#include <iostream>
-#ifdef __APPLE__
-#include <mach/mach.h>  // For macOS memory info
-#endif
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
+using Node = CompiledRule::Node;
+using Op = CompiledRule::Op;
+using Cmp = CompiledRule::Cmp;
+
+namespace {
+atomic<uint64_t> leafEvaluations{0};
+atomic<uint64_t> leavesSkipped{0};
+atomic<uint64_t> reorders{0};
+
+// Starting guesses in nanoseconds until a leaf has been timed
+double defaultCost(Op op) {
+    switch (op) {
+        case Op::True:
+        case Op::False: return 0;
+        case Op::Disk:
+        case Op::Cpu:
+        case Op::Memory: return 10;        // SystemMetrics snapshot read
+        case Op::Time: return 80;          // localtime_r
+        case Op::FileExists: return 1000;  // access(2)
+        default: return 0;
+    }
+}
+
+// Laplace-smoothed probability that a node holds
+double pTrue(uint64_t evals, uint64_t trues) {
+    return (trues + 1.0) / (evals + 2.0);
+}
+
+bool compare(double used, Cmp cmp, double threshold) {
+    if (used < 0) return false;
+    if (threshold < 0) return true;
+    double percent = used * 100;
+    switch (cmp) {
+        case Cmp::Gt: return percent > threshold;
+        case Cmp::Ge: return percent >= threshold;
+        case Cmp::Lt: return percent < threshold;
+        case Cmp::Le: return percent <= threshold;
+    }
+    return false;
+}
+
+Node leaf(Op op) {
+    Node n;
+    n.op = op;
+    return n;
+}
+
+// Plain load/store instead of read-modify-write: a lost update under
+// concurrent evaluation only nudges a heuristic
+void count(atomic<uint64_t>& counter) {
+    counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Interned programs keyed by the rule's JSON text
+mutex internMtx;
+unordered_map<string, CompiledRule> interned;
+}
+
+bool CompiledRule::evaluate() const {
+    if (!state_) return true;
+    const Program& program = *state_->program.load(memory_order_acquire);
+    const Instr* code = program.code.data();
+    const Node* nodes = program.nodes.data();
+    NodeStats* stats = state_->stats.get();
+    uint64_t leaves = 0, skipped = 0;
+    bool acc = true;
+    for (size_t pc = 0;;) {
+        const Instr& in = code[pc++];
+        switch (in.code) {
+            case Code::Leaf:
+                ++leaves;
+                acc = evaluateLeaf(nodes[in.node], stats[nodes[in.node].id]);
+                continue;
+            case Code::JumpIfFalse:
+                if (!acc) {
+                    skipped += in.skip;
+                    pc = in.target;
+                }
+                continue;
+            case Code::JumpIfTrue:
+                if (acc) {
+                    skipped += in.skip;
+                    pc = in.target;
+                }
+                continue;
+            case Code::Not:
+                acc = !acc;
+                continue;
+            case Code::Record: {
+                NodeStats& s = stats[nodes[in.node].id];
+                count(s.evals);
+                if (acc) count(s.trues);
+                continue;
+            }
+            case Code::Halt:
+                break;
+        }
+        break;
+    }
+    leafEvaluations.fetch_add(leaves, memory_order_relaxed);
+    if (skipped) leavesSkipped.fetch_add(skipped, memory_order_relaxed);
+    if (state_->runs.fetch_add(1, memory_order_relaxed) % kReorderEvery == kReorderEvery - 1) reorder();
+    return acc;
+}
+
+bool CompiledRule::evaluateLeaf(const Node& n, NodeStats& stats) const {
+    bool result;
+    // Time one evaluation in 64; the two clock reads cost more than the
+    // cheap leaves themselves
+    bool timed = (stats.evals.load(memory_order_relaxed) & 63) == 0;
+    chrono::steady_clock::time_point start;
+    if (timed) start = chrono::steady_clock::now();
+    switch (n.op) {
+        case Op::False:
+        case Op::Or: result = false; break; // an "or" only gets here without children
+        case Op::Disk: result = compare(SystemMetrics::instance().disk(n.mount), n.cmp, n.threshold); break;
+        case Op::Cpu: result = compare(SystemMetrics::instance().cpu(), n.cmp, n.threshold); break;
+        case Op::Memory: result = compare(SystemMetrics::instance().memory(), n.cmp, n.threshold); break;
+        case Op::FileExists: result = access(n.path.c_str(), F_OK) == 0; break;
+        case Op::Time: result = n.window.contains(TimeWindow::Clock::now()); break;
+        default: result = true;
+    }
+    if (timed) {
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        double old = stats.costNs.load(memory_order_relaxed);
+        stats.costNs.store(old == 0 ? ns : old * 0.8 + ns * 0.2, memory_order_relaxed);
+    }
+    count(stats.evals);
+    if (result) count(stats.trues);
+    return result;
+}
+
+bool CompiledRule::timeOnly() const {
+    if (!state_) return false;
+    for (const Node& n : state_->program.load(memory_order_acquire)->nodes) {
+        if (n.op == Op::Disk || n.op == Op::Cpu || n.op == Op::Memory || n.op == Op::FileExists) return false;
+    }
+    return true;
+}
+
+bool CompiledRule::holdsAt(TimeWindow::Clock::time_point t) const {
+    if (!state_) return true;
+    const Program& program = *state_->program.load(memory_order_acquire);
+    return program.nodes.empty() || holdsAt(program.nodes, 0, t);
+}
+
+// Plain tree walk without statistics; used for planning, not for runs
+bool CompiledRule::holdsAt(const vector<Node>& nodes, size_t index, TimeWindow::Clock::time_point t) const {
+    const Node& n = nodes[index];
+    switch (n.op) {
+        case Op::And:
+        case Op::Or: {
+            bool stopOn = n.op == Op::Or;
+            for (size_t c = index + 1; c < index + n.size; c += nodes[c].size) {
+                if (holdsAt(nodes, c, t) == stopOn) return stopOn;
+            }
+            return !stopOn;
+        }
+        case Op::Not: return !holdsAt(nodes, index + 1, t);
+        case Op::Time: return n.window.contains(t);
+        default: {
+            NodeStats scratch;
+            return evaluateLeaf(n, scratch);
+        }
+    }
+}
+
+TimeWindow::Clock::time_point CompiledRule::nextTransition(TimeWindow::Clock::time_point after) const {
+    auto next = TimeWindow::Clock::time_point::max();
+    if (!state_) return next;
+    for (const Node& n : state_->program.load(memory_order_acquire)->nodes) {
+        if (n.op == Op::Time) next = min(next, n.window.nextTransition(after));
+    }
+    return next;
+}
+
+void CompiledRule::assemble(Program& program) {
+    program.code.clear();
+    if (!program.nodes.empty()) emit(program, 0);
+    program.code.push_back({ Code::Halt, 0, 0, 0 });
+}
+
+// Appends the code for the subtree at `index`; the result ends up in the
+// accumulator. "and" jumps out on the first false child, "or" on the
+// first true one, straight to the Record that closes the subtree.
+void CompiledRule::emit(Program& program, size_t index) {
+    const Node& n = program.nodes[index];
+    auto& code = program.code;
+    uint32_t self = static_cast<uint32_t>(index);
+    switch (n.op) {
+        case Op::Not:
+            emit(program, index + 1);
+            code.push_back({ Code::Not, self, 0, 0 });
+            code.push_back({ Code::Record, self, 0, 0 });
+            return;
+        case Op::And:
+        case Op::Or: {
+            Code jump = n.op == Op::And ? Code::JumpIfFalse : Code::JumpIfTrue;
+            size_t end = index + n.size;
+            if (n.size == 1) {
+                // No children: evaluated like a constant leaf
+                code.push_back({ Code::Leaf, self, 0, 0 });
+                return;
+            }
+            vector<size_t> exits;
+            for (size_t c = index + 1; c < end;) {
+                emit(program, c);
+                size_t next = c + program.nodes[c].size;
+                if (next < end) {
+                    uint32_t skip = 0;
+                    for (size_t r = next; r < end; r += program.nodes[r].size) skip += program.nodes[r].leaves;
+                    exits.push_back(code.size());
+                    code.push_back({ jump, self, 0, skip });
+                }
+                c = next;
+            }
+            for (size_t e : exits) code[e].target = static_cast<uint32_t>(code.size());
+            code.push_back({ Code::Record, self, 0, 0 });
+            return;
+        }
+        default:
+            code.push_back({ Code::Leaf, self, 0, 0 });
+    }
+}
+
+void CompiledRule::reorder() const {
+    // One reorder at a time; evaluations keep using the published program
+    if (state_->reordering.exchange(true, memory_order_acquire)) return;
+    if (state_->versions.size() >= kMaxVersions) {
+        // Settled for good; keep reordering=true so no one tries again
+        return;
+    }
+    const Program* current = state_->program.load(memory_order_relaxed);
+    auto next = make_unique<Program>();
+    next->nodes.reserve(current->nodes.size());
+    rebuild(current->nodes, 0, next->nodes);
+    bool changed = false;
+    for (size_t i = 0; i < next->nodes.size() && !changed; ++i) {
+        changed = next->nodes[i].id != current->nodes[i].id;
+    }
+    if (changed) {
+        assemble(*next);
+        state_->program.store(next.get(), memory_order_release);
+        state_->versions.push_back(std::move(next));
+        reorders.fetch_add(1, memory_order_relaxed);
+    }
+    state_->reordering.store(false, memory_order_release);
+}
+
+// Copies the subtree at `index` into `out` with and/or children sorted by
+// expected cost per decisive outcome: cost / P(false) under "and",
+// cost / P(true) under "or" (the classic optimal order for independent
+// short-circuit tests). Returns the subtree's expected cost and P(true).
+CompiledRule::Estimate CompiledRule::rebuild(const vector<Node>& src, size_t index, vector<Node>& out) const {
+    const Node& n = src[index];
+    const NodeStats& stats = state_->stats[n.id];
+    double p = pTrue(stats.evals.load(memory_order_relaxed), stats.trues.load(memory_order_relaxed));
+    if (n.op == Op::Not) {
+        out.push_back(n);
+        return { rebuild(src, index + 1, out).cost, p };
+    }
+    if (n.op != Op::And && n.op != Op::Or) {
+        out.push_back(n);
+        double measured = stats.costNs.load(memory_order_relaxed);
+        return { measured > 0 ? measured : defaultCost(n.op), p };
+    }
+
+    struct Child {
+        vector<Node> nodes;
+        Estimate estimate;
+        double rank;
+    };
+    bool isAnd = n.op == Op::And;
+    vector<Child> children;
+    for (size_t c = index + 1; c < index + n.size; c += src[c].size) {
+        Child child;
+        child.estimate = rebuild(src, c, child.nodes);
+        double decisive = isAnd ? 1 - child.estimate.pTrue : child.estimate.pTrue;
+        child.rank = child.estimate.cost / max(decisive, 1e-3);
+        children.push_back(std::move(child));
+    }
+    auto expectedCost = [isAnd](const vector<Child*>& order) {
+        double cost = 0, reach = 1;
+        for (const Child* child : order) {
+            cost += reach * child->estimate.cost;
+            reach *= isAnd ? child->estimate.pTrue : 1 - child->estimate.pTrue;
+        }
+        return cost;
+    };
+    vector<Child*> order;
+    for (auto& child : children) order.push_back(&child);
+    double cost = expectedCost(order);
+    vector<Child*> sorted = order;
+    stable_sort(sorted.begin(), sorted.end(), [](const Child* a, const Child* b) { return a->rank < b->rank; });
+    // Only switch for a clear win so timing noise does not flip near-equal
+    // children back and forth
+    double sortedCost = expectedCost(sorted);
+    if (sortedCost < cost * 0.9) {
+        order = std::move(sorted);
+        cost = sortedCost;
+    }
+
+    out.push_back(n);
+    for (const Child* child : order) out.insert(out.end(), child->nodes.begin(), child->nodes.end());
+    return { cost, p };
+}
+
+CompiledRule RuleEngine::compile(const nlohmann::json& rule) {
+    bool expression = rule.is_string();
+    if (!expression && (!rule.is_object() || !rule.contains("if"))) return {};
+
+    string key = rule.dump();
+    {
+        lock_guard<mutex> lock(internMtx);
+        auto it = interned.find(key);
+        if (it != interned.end()) return it->second;
+    }
+    vector<Node> nodes;
+    if (expression) {
+        parseExpression(rule.get<string>(), nodes);
+    } else {
+        compileCondition(rule["if"], nodes);
+    }
+    CompiledRule compiled = build(std::move(nodes));
+    lock_guard<mutex> lock(internMtx);
+    // Another thread may have compiled the same rule meanwhile; keep the first
+    return interned.emplace(key, compiled).first->second;
+}
+
+CompiledRule RuleEngine::build(vector<Node> nodes) {
+    // Children follow their parent, so a reverse pass sees them first
+    for (size_t i = nodes.size(); i-- > 0;) {
+        Node& n = nodes[i];
+        n.id = static_cast<uint32_t>(i);
+        if (n.op == Op::And || n.op == Op::Or || n.op == Op::Not) {
+            n.leaves = 0;
+            for (size_t c = i + 1; c < i + n.size; c += nodes[c].size) n.leaves += nodes[c].leaves;
+        }
+    }
+    CompiledRule compiled;
+    compiled.state_ = make_shared<CompiledRule::State>();
+    compiled.state_->stats = make_unique<CompiledRule::NodeStats[]>(nodes.size());
+    auto program = make_unique<CompiledRule::Program>();
+    program->nodes = std::move(nodes);
+    CompiledRule::assemble(*program);
+    compiled.state_->program.store(program.get(), memory_order_relaxed);
+    compiled.state_->versions.push_back(std::move(program));
+    return compiled;
+}
+
+RuleEngine::Stats RuleEngine::stats() {
+    return { leafEvaluations.load(memory_order_relaxed), leavesSkipped.load(memory_order_relaxed),
+             reorders.load(memory_order_relaxed) };
+}
 
 bool RuleEngine::evaluate(const nlohmann::json& rule) {
-    if (!rule.contains("if")) return true;
-    
-    return evaluateCondition(rule["if"]);
+    return compile(rule).evaluate();
 }
 
-bool RuleEngine::evaluateCondition(const nlohmann::json& condition) {
+void RuleEngine::compileCondition(const nlohmann::json& condition, vector<Node>& out) {
     if (condition.is_string()) {
         // Simple string condition (backward compatibility)
-        return evaluateSimpleCondition(condition);
+        out.push_back(compileSimpleCondition(condition.get<string>()));
     } else if (condition.is_object()) {
         // Complex condition object
+        Op op;
+        const char* key;
         if (condition.contains("and")) {
-            for (const auto& sub : condition["and"]) {
-                if (!evaluateCondition(sub)) return false;
-            }
-            return true;
+            op = Op::And;
+            key = "and";
         } else if (condition.contains("or")) {
-            for (const auto& sub : condition["or"]) {
-                if (evaluateCondition(sub)) return true;
-            }
-            return false;
+            op = Op::Or;
+            key = "or";
         } else if (condition.contains("not")) {
-            return !evaluateCondition(condition["not"]);
+            op = Op::Not;
+            key = "not";
         } else {
             // Single condition object
-            return evaluateSingleCondition(condition);
+            compileSingleCondition(condition, out);
+            return;
+        }
+        size_t self = out.size();
+        out.push_back(leaf(op));
+        if (op == Op::Not) {
+            compileCondition(condition[key], out);
+        } else {
+            for (const auto& sub : condition[key]) compileCondition(sub, out);
         }
+        out[self].size = static_cast<uint32_t>(out.size() - self);
+    } else {
+        out.push_back(leaf(Op::True));
     }
-    return true;
 }
 
-bool RuleEngine::evaluateSingleCondition(const nlohmann::json& cond) {
+void RuleEngine::compileSingleCondition(const nlohmann::json& cond, vector<Node>& out) {
+    auto text = [&](const char* key) {
+        if (!cond[key].is_string()) {
+            throw invalid_argument(string("rule condition '") + key + "' must be a string");
+        }
+        return cond[key].get<string>();
+    };
     if (cond.contains("disk")) {
-        return evaluateDiskCondition(cond["disk"]);
+        // Optional "mount" picks the filesystem; default is the working directory
+        out.push_back(compileDiskCondition(text("disk"), cond.contains("mount") ? text("mount") : "."));
     } else if (cond.contains("cpu")) {
-        return evaluateCpuCondition(cond["cpu"]);
+        out.push_back(compileThreshold(Op::Cpu, text("cpu")));
     } else if (cond.contains("memory")) {
-        return evaluateMemoryCondition(cond["memory"]);
+        out.push_back(compileThreshold(Op::Memory, text("memory")));
     } else if (cond.contains("file")) {
-        return evaluateFileCondition(cond["file"]);
+        out.push_back(compileFileCondition(text("file")));
     } else if (cond.contains("time")) {
-        return evaluateTimeCondition(cond["time"]);
+        out.push_back(compileTimeCondition(text("time")));
+    } else {
+        out.push_back(leaf(Op::True));
     }
-    return true;
-}
-
-bool RuleEngine::evaluateSimpleCondition(const string& cond) {
-    if (cond.find("disk") != string::npos) {
-        struct statvfs stat;
-        if (statvfs(".", &stat) != 0) return false;
-        double used = 1.0 - (double)stat.f_bavail / stat.f_blocks;
-        regex pattern(R"(disk\s*>\s*(\d+)%?)");
-        smatch match;
-        if (regex_search(cond, match, pattern)) {
-            int percent = stoi(match[1]);
-            return (used * 100) > percent;
-        }
-    }
-    return true;
 }
 
-bool RuleEngine::evaluateDiskCondition(const string& cond) {
-    struct statvfs stat;
-    if (statvfs(".", &stat) != 0) return false;
-    double used = 1.0 - (double)stat.f_bavail / stat.f_blocks;
-    
-    regex pattern(R"(>\s*(\d+)%?)");
+Node RuleEngine::compileSimpleCondition(const string& cond) {
+    if (cond.find("disk") == string::npos) return leaf(Op::True);
+    static const regex pattern(R"(disk\s*>\s*(\d+)%?)");
     smatch match;
-    if (regex_search(cond, match, pattern)) {
-        int percent = stoi(match[1]);
-        return (used * 100) > percent;
-    }
-    return false;
+    Node n = leaf(Op::Disk);
+    // Without a threshold the condition only requires the disk to be readable
+    n.threshold = regex_search(cond, match, pattern) ? stod(match[1]) : -1;
+    n.mount = static_cast<uint32_t>(SystemMetrics::instance().watchMount("."));
+    return n;
 }
 
-bool RuleEngine::evaluateCpuCondition(const string& cond) {
-    // Note: This is a simplified CPU usage check
-    // In a real implementation, you'd use system calls or libraries like sys/stat.h
-    // For demonstration, we'll return true if condition is "> 50%"
-    regex pattern(R"(>\s*(\d+)%?)");
-    smatch match;
-    if (regex_search(cond, match, pattern)) {
-        int threshold = stoi(match[1]);
-        // Placeholder: In real code, calculate actual CPU usage
-        double cpuUsage = 60.0; // Simulated
-        return cpuUsage > threshold;
+Node RuleEngine::compileDiskCondition(const string& cond, const string& mount) {
+    Node n = compileThreshold(Op::Disk, cond);
+    if (n.op == Op::Disk) {
+        n.mount = static_cast<uint32_t>(SystemMetrics::instance().watchMount(mount));
     }
-    return false;
+    return n;
 }
 
-bool RuleEngine::evaluateMemoryCondition(const string& cond) {
-#ifdef __APPLE__
-    // macOS memory info using mach
-    mach_msg_type_number_t count = HOST_VM_INFO_COUNT;
-    vm_statistics_data_t vmstat;
-    if (host_statistics(mach_host_self(), HOST_VM_INFO, (host_info_t)&vmstat, &count) != KERN_SUCCESS) {
-        return false;
-    }
-
-    double used = 1.0 - (double)vmstat.free_count / (vmstat.free_count + vmstat.active_count + vmstat.inactive_count + vmstat.wire_count);
-#else
-    double used = 0.5; // Stub for linux
-#endif
-
-    regex pattern(R"(>\s*(\d+)%?)");
+Node RuleEngine::compileThreshold(Op op, const string& cond) {
+    static const regex pattern(R"(>\s*(\d+)%?)");
     smatch match;
-    if (regex_search(cond, match, pattern)) {
-        int percent = stoi(match[1]);
-        return (used * 100) > percent;
-    }
-    return false;
+    if (!regex_search(cond, match, pattern)) return leaf(Op::False);
+    Node n = leaf(op);
+    n.threshold = stod(match[1]);
+    return n;
 }
 
-bool RuleEngine::evaluateFileCondition(const string& cond) {
+Node RuleEngine::compileFileCondition(const string& cond) {
     // Example: "exists /path/to/file"
-    if (cond.find("exists") == 0) {
-        string path = cond.substr(7);
-        return access(path.c_str(), F_OK) == 0;
-    }
-    return false;
+    if (cond.find("exists") != 0) return leaf(Op::False);
+    Node n = leaf(Op::FileExists);
+    n.path = cond.size() > 7 ? cond.substr(7) : "";
+    return n;
 }
 
-bool RuleEngine::evaluateTimeCondition(const string& cond) {
-    // Example: "between 09:00 and 17:00"
-    time_t now = time(nullptr);
-    tm* local = localtime(&now);
-    int currentHour = local->tm_hour;
-    
-    regex pattern(R"(between\s+(\d+):(\d+)\s+and\s+(\d+):(\d+))");
+Node RuleEngine::compileTimeCondition(const string& cond) {
+    // Example: "between 09:00 and 17:00"; both ends inclusive, to the minute.
+    // A window whose end is earlier than its start runs past midnight.
+    static const regex pattern(R"(between\s+(\d+):(\d+)\s+and\s+(\d+):(\d+))");
     smatch match;
-    if (regex_search(cond, match, pattern)) {
-        int startHour = stoi(match[1]);
-        int endHour = stoi(match[3]);
-        return currentHour >= startHour && currentHour <= endHour;
+    if (!regex_search(cond, match, pattern)) return leaf(Op::False);
+    int fromHour = stoi(match[1]), fromMinute = stoi(match[2]);
+    int toHour = stoi(match[3]), toMinute = stoi(match[4]);
+    if (fromHour > 23 || toHour > 23 || fromMinute > 59 || toMinute > 59) {
+        throw invalid_argument("time condition '" + cond + "' is not a valid HH:MM range");
     }
-    return false;
+    Node n = leaf(Op::Time);
+    n.window.from = fromHour * 60 + fromMinute;
+    n.window.to = toHour * 60 + toMinute;
+    return n;
 }
@@ -1,18 +1,126 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 #include "utils/json.hpp"
+#include "TimeWindow.h"
+
+// A rule compiled once into a flat bytecode program: conditions become
+// leaf instructions with pre-parsed operands, and and/or/not become
+// conditional jumps, so evaluating it is one tight dispatch loop with no
+// JSON lookups, regexes or allocations. JSON rules and rule expressions
+// compile to the same program. A default constructed rule always holds.
+//
+// The program is assembled from a pre-order array of typed nodes that
+// keeps running counts of how often each node was evaluated and held;
+// leaves also keep a sampled cost. Every kReorderEvery evaluations the
+// children of each and/or are re-sorted so the cheapest, most decisive
+// ones run first and the program is re-assembled; the new one is published
+// with an atomic pointer swap. Copies of a rule share program and
+// statistics.
+class CompiledRule {
+public:
+    static constexpr uint64_t kReorderEvery = 64;
+    static constexpr size_t kMaxVersions = 16;
+
+    bool evaluate() const;
+    bool empty() const { return !state_; }
+
+    // True when only time-of-day conditions (and constants) decide the rule,
+    // so its future value can be computed instead of polled
+    bool timeOnly() const;
+    // Value of the rule at `t`; time conditions are evaluated at `t`, any
+    // other condition as of now
+    bool holdsAt(TimeWindow::Clock::time_point t) const;
+    // Earliest instant after `after` at which a time condition in the rule
+    // changes value; time_point::max() if none ever does
+    TimeWindow::Clock::time_point nextTransition(TimeWindow::Clock::time_point after) const;
+
+    enum class Op : uint8_t {
+        True, False, And, Or, Not,
+        Disk, Cpu, Memory, FileExists, Time
+    };
+    enum class Cmp : uint8_t { Gt, Ge, Lt, Le };
+    struct Node {
+        Op op = Op::True;
+        Cmp cmp = Cmp::Gt;     // Disk/Cpu/Memory: usage percent <cmp> threshold
+        uint32_t size = 1;     // nodes in this subtree, itself included
+        uint32_t leaves = 1;   // leaf nodes in this subtree
+        uint32_t id = 0;       // position at compile time; keys the statistics
+        double threshold = 0;  // < 0 only checks that the metric is available
+        uint32_t mount = 0;    // Disk: slot in SystemMetrics
+        TimeWindow window;     // Time
+        std::string path;      // FileExists
+    };
+private:
+    friend class RuleEngine;
+    enum class Code : uint8_t { Leaf, JumpIfFalse, JumpIfTrue, Not, Record, Halt };
+    struct Instr {
+        Code code;
+        uint32_t node;   // Leaf/Record: index into Program::nodes
+        uint32_t target; // jumps
+        uint32_t skip;   // jumps: leaves passed over when taken
+    };
+    struct Program {
+        std::vector<Node> nodes;
+        std::vector<Instr> code;
+    };
+    struct NodeStats {
+        std::atomic<uint64_t> evals{0};
+        std::atomic<uint64_t> trues{0};
+        std::atomic<double> costNs{0}; // leaves only: moving average of sampled runs
+    };
+    struct State {
+        std::atomic<const Program*> program{nullptr};
+        // Every published program; readers may still be running an old one,
+        // so they live as long as the rule (at most kMaxVersions)
+        std::vector<std::unique_ptr<const Program>> versions;
+        std::unique_ptr<NodeStats[]> stats;
+        std::atomic<uint64_t> runs{0};
+        std::atomic<bool> reordering{false};
+    };
+    struct Estimate {
+        double cost;
+        double pTrue;
+    };
+
+    bool evaluateLeaf(const Node& n, NodeStats& stats) const;
+    bool holdsAt(const std::vector<Node>& nodes, size_t index, TimeWindow::Clock::time_point t) const;
+    void reorder() const;
+    Estimate rebuild(const std::vector<Node>& src, size_t index, std::vector<Node>& out) const;
+    static void assemble(Program& program);
+    static void emit(Program& program, size_t index);
+    std::shared_ptr<State> state_;
+};
 
 class RuleEngine {
 public:
+    struct Stats {
+        uint64_t leafEvaluations;
+        uint64_t leavesSkipped; // leaves short-circuiting spared
+        uint64_t reorders;
+    };
+
+    // Accepts the JSON form ({"if": ...}) or an expression string such as
+    // disk("/var") > 80 && !exists("/tmp/lock"). Identical rules share one
+    // compiled program. Throws std::invalid_argument on malformed rules.
+    static CompiledRule compile(const nlohmann::json& rule);
+    // One-shot helper: compile and evaluate
     static bool evaluate(const nlohmann::json& rule);
-    
+    static Stats stats();
+
 private:
-    static bool evaluateCondition(const nlohmann::json& condition);
-    static bool evaluateSingleCondition(const nlohmann::json& cond);
-    static bool evaluateSimpleCondition(const std::string& cond);
-    static bool evaluateDiskCondition(const std::string& cond);
-    static bool evaluateCpuCondition(const std::string& cond);
-    static bool evaluateMemoryCondition(const std::string& cond);
-    static bool evaluateFileCondition(const std::string& cond);
-    static bool evaluateTimeCondition(const std::string& cond);
+    class ExpressionParser;
+    // Defined in RuleExpression.cpp
+    static void parseExpression(const std::string& text, std::vector<CompiledRule::Node>& out);
+    static CompiledRule build(std::vector<CompiledRule::Node> nodes);
+    static void compileCondition(const nlohmann::json& condition, std::vector<CompiledRule::Node>& out);
+    static void compileSingleCondition(const nlohmann::json& cond, std::vector<CompiledRule::Node>& out);
+    static CompiledRule::Node compileSimpleCondition(const std::string& cond);
+    static CompiledRule::Node compileDiskCondition(const std::string& cond, const std::string& mount);
+    static CompiledRule::Node compileThreshold(CompiledRule::Op op, const std::string& cond);
+    static CompiledRule::Node compileFileCondition(const std::string& cond);
+    static CompiledRule::Node compileTimeCondition(const std::string& cond);
 };
@@ -0,0 +1,226 @@
+#include "RuleEngine.h"
+#include "SystemMetrics.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+using namespace std;
+using Node = CompiledRule::Node;
+using Op = CompiledRule::Op;
+using Cmp = CompiledRule::Cmp;
+
+// Recursive-descent parser for rule expressions:
+//
+//   expr    := and ('||' and)*
+//   and     := unary ('&&' unary)*
+//   unary   := '!' unary | primary
+//   primary := '(' expr ')' | 'true' | 'false'
+//            | ('cpu' | 'memory') ['(' ')'] cmp number ['%']
+//            | 'disk' ['(' string ')'] cmp number ['%']
+//            | 'hour' cmp number
+//            | 'exists' '(' string ')'
+//            | 'time' '(' string ')'          -- same text as the JSON "time" condition
+//   cmp     := '>' | '>=' | '<' | '<='
+//
+// Output is the same pre-order node array the JSON form compiles to, with
+// chains of && / || flattened into one node.
+class RuleEngine::ExpressionParser {
+public:
+    ExpressionParser(const string& text, vector<Node>& out) : text_(text), out_(out) {}
+
+    void parse() {
+        vector<Node> root = parseOr();
+        skipSpace();
+        if (pos_ != text_.size()) fail("unexpected '" + string(1, text_[pos_]) + "'");
+        out_.insert(out_.end(), root.begin(), root.end());
+    }
+
+private:
+    [[noreturn]] void fail(const string& what) const {
+        throw invalid_argument("rule expression: " + what + " at offset " + to_string(pos_) + " in '" + text_ + "'");
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+    }
+
+    bool accept(const char* token) {
+        skipSpace();
+        size_t len = char_traits<char>::length(token);
+        if (text_.compare(pos_, len, token) != 0) return false;
+        pos_ += len;
+        return true;
+    }
+
+    void expect(const char* token) {
+        if (!accept(token)) fail(string("expected '") + token + "'");
+    }
+
+    vector<Node> combine(Op op, vector<vector<Node>>& parts) {
+        if (parts.size() == 1) return std::move(parts[0]);
+        vector<Node> result(1);
+        result[0].op = op;
+        for (auto& part : parts) result.insert(result.end(), part.begin(), part.end());
+        result[0].size = static_cast<uint32_t>(result.size());
+        return result;
+    }
+
+    vector<Node> parseOr() {
+        vector<vector<Node>> parts;
+        parts.push_back(parseAnd());
+        while (accept("||")) parts.push_back(parseAnd());
+        return combine(Op::Or, parts);
+    }
+
+    vector<Node> parseAnd() {
+        vector<vector<Node>> parts;
+        parts.push_back(parseUnary());
+        while (accept("&&")) parts.push_back(parseUnary());
+        return combine(Op::And, parts);
+    }
+
+    vector<Node> parseUnary() {
+        skipSpace();
+        // "!=" is not an operator here, but keep '!' from eating it silently
+        if (pos_ < text_.size() && text_[pos_] == '!' && text_.compare(pos_, 2, "!=") != 0) {
+            ++pos_;
+            vector<Node> operand = parseUnary();
+            vector<Node> result(1);
+            result[0].op = Op::Not;
+            result.insert(result.end(), operand.begin(), operand.end());
+            result[0].size = static_cast<uint32_t>(result.size());
+            return result;
+        }
+        return parsePrimary();
+    }
+
+    string identifier() {
+        skipSpace();
+        size_t start = pos_;
+        while (pos_ < text_.size() && (isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_')) ++pos_;
+        return text_.substr(start, pos_ - start);
+    }
+
+    string stringLiteral() {
+        skipSpace();
+        if (pos_ >= text_.size() || text_[pos_] != '"') fail("expected a string literal");
+        string value;
+        for (++pos_; pos_ < text_.size() && text_[pos_] != '"'; ++pos_) {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) ++pos_;
+            value += text_[pos_];
+        }
+        if (pos_ >= text_.size()) fail("unterminated string");
+        ++pos_;
+        return value;
+    }
+
+    double number() {
+        skipSpace();
+        size_t start = pos_;
+        while (pos_ < text_.size() && (isdigit(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '.')) ++pos_;
+        if (start == pos_) fail("expected a number");
+        try {
+            return stod(text_.substr(start, pos_ - start));
+        } catch (...) {
+            pos_ = start;
+            fail("invalid number");
+        }
+    }
+
+    Cmp comparison() {
+        if (accept(">=")) return Cmp::Ge;
+        if (accept("<=")) return Cmp::Le;
+        if (accept(">")) return Cmp::Gt;
+        if (accept("<")) return Cmp::Lt;
+        fail("expected a comparison (>, >=, <, <=)");
+    }
+
+    Node metric(Op op) {
+        Node n;
+        n.op = op;
+        n.cmp = comparison();
+        n.threshold = number();
+        accept("%");
+        return n;
+    }
+
+    Node hour() {
+        Cmp cmp = comparison();
+        size_t at = pos_;
+        double value = number();
+        if (value != static_cast<int>(value)) {
+            pos_ = at;
+            fail("hour must be a whole number");
+        }
+        int h = static_cast<int>(value);
+        // Whole hours as a minute window: "hour <= 17" lasts until 17:59
+        int from = 0, to = 23;
+        switch (cmp) {
+            case Cmp::Gt: from = h + 1; break;
+            case Cmp::Ge: from = h; break;
+            case Cmp::Lt: to = h - 1; break;
+            case Cmp::Le: to = h; break;
+        }
+        Node n;
+        from = max(from, 0);
+        to = min(to, 23);
+        if (from > to) {
+            n.op = Op::False;
+            return n;
+        }
+        n.op = Op::Time;
+        n.window.from = from * 60;
+        n.window.to = to * 60 + 59;
+        return n;
+    }
+
+    vector<Node> parsePrimary() {
+        if (accept("(")) {
+            vector<Node> inner = parseOr();
+            expect(")");
+            return inner;
+        }
+        size_t at = pos_;
+        string name = identifier();
+        Node n;
+        if (name == "true") {
+            n.op = Op::True;
+        } else if (name == "false") {
+            n.op = Op::False;
+        } else if (name == "cpu" || name == "memory") {
+            if (accept("(")) expect(")");
+            n = metric(name == "cpu" ? Op::Cpu : Op::Memory);
+        } else if (name == "disk") {
+            string mount = ".";
+            if (accept("(")) {
+                mount = stringLiteral();
+                expect(")");
+            }
+            n = metric(Op::Disk);
+            n.mount = static_cast<uint32_t>(SystemMetrics::instance().watchMount(mount));
+        } else if (name == "hour") {
+            n = hour();
+        } else if (name == "exists") {
+            expect("(");
+            n.op = Op::FileExists;
+            n.path = stringLiteral();
+            expect(")");
+        } else if (name == "time") {
+            expect("(");
+            n = RuleEngine::compileTimeCondition(stringLiteral());
+            expect(")");
+        } else {
+            pos_ = at;
+            skipSpace();
+            fail(name.empty() ? "expected a condition" : "unknown condition '" + name + "'");
+        }
+        return { n };
+    }
+
+    const string& text_;
+    vector<Node>& out_;
+    size_t pos_ = 0;
+};
+
+void RuleEngine::parseExpression(const string& text, vector<Node>& out) {
+    ExpressionParser(text, out).parse();
+}
@@ -0,0 +1,159 @@
+#include "Schedule.h"
+#include <cctype>
+#include <ctime>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+namespace {
+// Expands one cron field ("*", "5", "1-5", "*/10", "0-30/5", lists of those)
+// into a bitmask over [lo, hi]
+template<size_t N>
+bitset<N> parseField(const string& field, int lo, int hi, const char* what) {
+    bitset<N> bits;
+    auto fail = [&]() -> void {
+        throw invalid_argument(string("invalid ") + what + " field '" + field + "'");
+    };
+    auto number = [&](const string& s) {
+        if (s.empty()) fail();
+        for (char c : s) if (!isdigit(static_cast<unsigned char>(c))) fail();
+        return stoi(s);
+    };
+    stringstream ss(field);
+    string part;
+    while (getline(ss, part, ',')) {
+        int step = 1;
+        size_t slash = part.find('/');
+        if (slash != string::npos) {
+            step = number(part.substr(slash + 1));
+            if (step <= 0) fail();
+            part = part.substr(0, slash);
+        }
+        int first = lo, last = hi;
+        if (part != "*") {
+            size_t dash = part.find('-');
+            if (dash == string::npos) {
+                first = number(part);
+                // "5/15" means from 5 to the end of the range
+                last = slash != string::npos ? hi : first;
+            } else {
+                first = number(part.substr(0, dash));
+                last = number(part.substr(dash + 1));
+            }
+        }
+        if (first < lo || last > hi || first > last) fail();
+        for (int v = first; v <= last; v += step) bits.set(v);
+    }
+    if (bits.none()) fail();
+    return bits;
+}
+
+Schedule::Clock::duration parseInterval(const string& text) {
+    Schedule::Clock::duration total{0};
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t start = i;
+        while (i < text.size() && isdigit(static_cast<unsigned char>(text[i]))) ++i;
+        if (start == i || i == text.size()) throw invalid_argument("invalid interval '" + text + "'");
+        long long n = stoll(text.substr(start, i - start));
+        switch (text[i++]) {
+            case 's': total += chrono::seconds(n); break;
+            case 'm': total += chrono::minutes(n); break;
+            case 'h': total += chrono::hours(n); break;
+            case 'd': total += chrono::hours(24 * n); break;
+            default: throw invalid_argument("invalid interval '" + text + "'");
+        }
+    }
+    if (total <= Schedule::Clock::duration::zero()) throw invalid_argument("invalid interval '" + text + "'");
+    return total;
+}
+}
+
+Schedule Schedule::parse(const string& spec) {
+    Schedule s;
+    s.spec_ = spec;
+    string expr = spec;
+    if (expr == "@hourly") expr = "0 * * * *";
+    else if (expr == "@daily" || expr == "@midnight") expr = "0 0 * * *";
+    else if (expr == "@weekly") expr = "0 0 * * 0";
+    else if (expr == "@monthly") expr = "0 0 1 * *";
+    else if (expr.rfind("@every ", 0) == 0) {
+        s.interval_ = parseInterval(expr.substr(7));
+        return s;
+    }
+
+    stringstream ss(expr);
+    vector<string> fields;
+    string f;
+    while (ss >> f) fields.push_back(f);
+    if (fields.size() != 5) {
+        throw invalid_argument("expected 5 cron fields or @every <interval>, got '" + spec + "'");
+    }
+    s.minutes_ = parseField<60>(fields[0], 0, 59, "minute");
+    s.hours_ = parseField<24>(fields[1], 0, 23, "hour");
+    s.days_ = parseField<32>(fields[2], 1, 31, "day-of-month");
+    s.months_ = parseField<13>(fields[3], 1, 12, "month");
+    // Both 0 and 7 mean Sunday
+    bitset<8> weekdays = parseField<8>(fields[4], 0, 7, "day-of-week");
+    for (int d = 0; d < 7; ++d) s.weekdays_[d] = weekdays[d];
+    if (weekdays[7]) s.weekdays_.set(0);
+    s.anyDay_ = fields[2] == "*";
+    s.anyWeekday_ = fields[4] == "*";
+    // Well-formed fields can still describe a date that never comes
+    // ("0 0 30 2 *"); reject those here rather than when the scheduler plans
+    try {
+        s.next(Clock::now());
+    } catch (const runtime_error&) {
+        throw invalid_argument("schedule '" + spec + "' never fires");
+    }
+    return s;
+}
+
+bool Schedule::dayMatches(int mday, int wday) const {
+    // Classic cron: when both day fields are restricted, either may match
+    if (!anyDay_ && !anyWeekday_) return days_[mday] || weekdays_[wday];
+    return days_[mday] && weekdays_[wday];
+}
+
+Schedule::Clock::time_point Schedule::next(Clock::time_point after) const {
+    if (interval_ != Clock::duration::zero()) return after + interval_;
+
+    // Walk forward field by field, skipping whole months/days/hours that
+    // cannot match instead of testing every minute
+    time_t t = Clock::to_time_t(after);
+    tm local{};
+    localtime_r(&t, &local);
+    local.tm_sec = 0;
+    local.tm_min += 1;
+    local.tm_isdst = -1;
+    t = mktime(&local);
+
+    // Four years covers every Feb 29th schedule
+    const time_t limit = t + 4 * 366 * 24 * 3600;
+    while (t <= limit) {
+        localtime_r(&t, &local);
+        local.tm_isdst = -1;
+        if (!months_[local.tm_mon + 1]) {
+            local.tm_mon += 1;
+            local.tm_mday = 1;
+            local.tm_hour = 0;
+            local.tm_min = 0;
+        } else if (!dayMatches(local.tm_mday, local.tm_wday)) {
+            local.tm_mday += 1;
+            local.tm_hour = 0;
+            local.tm_min = 0;
+        } else if (!hours_[local.tm_hour]) {
+            local.tm_hour += 1;
+            local.tm_min = 0;
+        } else if (!minutes_[local.tm_min]) {
+            local.tm_min += 1;
+        } else {
+            return Clock::from_time_t(t);
+        }
+        time_t advanced = mktime(&local);
+        // A DST fold can map the new wall time back onto the old instant
+        t = advanced > t ? advanced : t + 60;
+    }
+    throw runtime_error("schedule '" + spec_ + "' never fires");
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <bitset>
+#include <chrono>
+#include <string>
+
+// When a workflow should fire in daemon mode. Accepts a 5-field cron
+// expression ("*/15 9-17 * * 1-5", local time), the @hourly/@daily/
+// @weekly/@monthly shorthands, or a fixed interval ("@every 30s",
+// "@every 1h30m").
+class Schedule {
+public:
+    using Clock = std::chrono::system_clock;
+
+    // Throws std::invalid_argument with a description of the bad field, or
+    // if the expression can never fire
+    static Schedule parse(const std::string& spec);
+
+    // First firing time strictly after `after`
+    Clock::time_point next(Clock::time_point after) const;
+    const std::string& spec() const { return spec_; }
+    bool isInterval() const { return interval_ != Clock::duration::zero(); }
+private:
+    Schedule() = default;
+    bool dayMatches(int mday, int wday) const;
+
+    std::string spec_;
+    Clock::duration interval_{0}; // non-zero for @every
+    std::bitset<60> minutes_;
+    std::bitset<24> hours_;
+    std::bitset<32> days_;        // 1-31
+    std::bitset<13> months_;      // 1-12
+    std::bitset<7> weekdays_;     // 0 = Sunday
+    bool anyDay_ = true;
+    bool anyWeekday_ = true;
+};
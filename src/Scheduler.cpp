@@ -0,0 +1,68 @@
+#include "Scheduler.h"
+#include <iostream>
+using namespace std;
+
+Scheduler::~Scheduler() {
+    stop();
+}
+
+void Scheduler::add(const Schedule& schedule, function<void()> fire, Gate gate) {
+    entries_.push_back({ schedule, std::move(fire), std::move(gate) });
+}
+
+Scheduler::Clock::time_point Scheduler::plan(const Entry& entry, Clock::time_point after) const {
+    Clock::time_point next = entry.schedule.next(after);
+    if (!entry.gate) return next;
+    // Each round either lands on an open tick or jumps to the next opening
+    for (int round = 0; round < 64; ++round) {
+        Clock::time_point open = entry.gate(next);
+        if (open == Clock::time_point::max()) return open;
+        if (open <= next) return next;
+        // Intervals restart at the opening; cron waits for its next tick there
+        next = entry.schedule.isInterval() ? open : entry.schedule.next(open - chrono::seconds(1));
+    }
+    return next;
+}
+
+void Scheduler::start() {
+    Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        Clock::time_point next = plan(entries_[i], now);
+        if (next != Clock::time_point::max()) heap_.push({ next, i });
+    }
+    thread_ = thread([this] { run(); });
+}
+
+void Scheduler::stop() {
+    {
+        lock_guard<mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void Scheduler::run() {
+    unique_lock<mutex> lock(mtx_);
+    while (!stop_ && !heap_.empty()) {
+        Due due = heap_.top();
+        if (cv_.wait_until(lock, due.when, [this] { return stop_; })) break;
+        if (Clock::now() < due.when) continue;
+        heap_.pop();
+
+        Entry& entry = entries_[due.entry];
+        lock.unlock();
+        try {
+            entry.fire();
+        } catch (const exception& e) {
+            cerr << "Scheduler: firing '" << entry.schedule.spec() << "' failed: " << e.what() << "\n";
+        }
+        // Fixed intervals keep their cadence; anything that fell behind
+        // (suspend, clock jump) resumes from now instead of catching up
+        Clock::time_point now = Clock::now();
+        Clock::time_point next = plan(entry, due.when);
+        if (next <= now) next = plan(entry, now);
+        lock.lock();
+        if (next != Clock::time_point::max()) heap_.push({ next, due.entry });
+    }
+}
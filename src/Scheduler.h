@@ -0,0 +1,56 @@
+#pragma once
+#include "Schedule.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// In-process cron for daemon mode. Next firing times sit in a min-heap; one
+// thread sleeps until the earliest is due and calls its fire callback, which
+// is expected to hand the real work to the executor and return.
+class Scheduler {
+public:
+    using Clock = Schedule::Clock;
+
+    Scheduler() = default;
+    ~Scheduler();
+
+    // Earliest time at or after the given one at which a run would do
+    // anything; lets the scheduler sleep through stretches where the
+    // workflow's rule is known to be false. time_point::max() means never.
+    using Gate = std::function<Clock::time_point(Clock::time_point)>;
+
+    // Entries must be added before start()
+    void add(const Schedule& schedule, std::function<void()> fire, Gate gate = nullptr);
+    void start();
+    // Stops firing; runs already handed off are not waited for
+    void stop();
+    size_t size() const { return entries_.size(); }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+private:
+    struct Entry {
+        Schedule schedule;
+        std::function<void()> fire;
+        Gate gate;
+    };
+    struct Due {
+        Clock::time_point when;
+        size_t entry;
+        bool operator>(const Due& other) const { return when > other.when; }
+    };
+
+    void run();
+    // Next firing time strictly after `after`, or max() if the gate never opens
+    Clock::time_point plan(const Entry& entry, Clock::time_point after) const;
+
+    std::vector<Entry> entries_;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> heap_;
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,588 @@
+#include "StateJournal.h"
+#include "utils/JSONParser.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+using namespace std;
+using nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t kHeaderSize = 16;
+// Snapshot key holding the last journal record folded into it
+const char* kSeqKey = "_journalSeq";
+
+uint32_t checksum(uint64_t seq, const char* payload, size_t size) {
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(&seq), sizeof(seq));
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(payload), static_cast<uInt>(size));
+    return static_cast<uint32_t>(crc);
+}
+
+void encodeRecord(string& out, uint64_t seq, const vector<uint8_t>& payload) {
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    uint32_t crc = checksum(seq, reinterpret_cast<const char*>(payload.data()), payload.size());
+    out.append(reinterpret_cast<const char*>(&length), 4);
+    out.append(reinterpret_cast<const char*>(&crc), 4);
+    out.append(reinterpret_cast<const char*>(&seq), 8);
+    out.append(reinterpret_cast<const char*>(payload.data()), payload.size());
+}
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void applyOps(json& state, const json& ops) {
+    for (const json& op : ops) {
+        const string& kind = op.at("op").get_ref<const string&>();
+        json& target = state[json::json_pointer(op.at("path").get<string>())];
+        if (kind == "set") {
+            target = op.at("value");
+        } else if (kind == "add") {
+            double current = target.is_number() ? target.get<double>() : 0.0;
+            double sum = current + op.at("value").get<double>();
+            if (sum == static_cast<double>(static_cast<int64_t>(sum))) target = static_cast<int64_t>(sum);
+            else target = sum;
+        } else if (kind == "push") {
+            if (!target.is_array()) target = json::array();
+            target.push_back(op.at("value"));
+            size_t keep = op.value("keep", size_t(0));
+            if (keep > 0 && target.size() > keep) {
+                target.erase(target.begin(), target.begin() + static_cast<ptrdiff_t>(target.size() - keep));
+            }
+        }
+    }
+}
+
+// A snapshot that does not parse is reported with the offending byte and
+// treated as empty; `corrupt` tells the caller to keep it out of the way
+json loadSnapshot(const string& path, uint64_t& seq, bool* corrupt = nullptr) {
+    seq = 0;
+    error_code ec;
+    if (!fs::exists(path, ec)) return json::object();
+    json state;
+    try {
+        state = JSONParser::parseFileStrict(path);
+    } catch (const JSONParser::ParseError& e) {
+        cerr << "StateJournal: unreadable snapshot: " << e.what() << " (byte " << e.offset() << ")\n";
+        if (corrupt) *corrupt = true;
+        return json::object();
+    }
+    if (!state.is_object()) {
+        cerr << "StateJournal: snapshot " << path << " is not an object\n";
+        if (corrupt) *corrupt = true;
+        return json::object();
+    }
+    auto it = state.find(kSeqKey);
+    if (it != state.end()) {
+        if (it->is_number_unsigned()) seq = it->get<uint64_t>();
+        state.erase(it);
+    }
+    return state;
+}
+
+// Applies the records after `seq`, starting at byte `from`; returns where
+// the intact part ends
+uint64_t replay(const string& file, json& state, uint64_t& seq, uint64_t from = 0) {
+    ifstream in(file, ios::binary | ios::ate);
+    if (!in) return from;
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    if (from >= size || !in.seekg(static_cast<streamoff>(from))) return from;
+    uint64_t good = from;
+    vector<char> payload;
+    char header[kHeaderSize];
+    while (in.read(header, kHeaderSize)) {
+        uint32_t length, crc;
+        uint64_t recordSeq;
+        memcpy(&length, header, 4);
+        memcpy(&crc, header + 4, 4);
+        memcpy(&recordSeq, header + 8, 8);
+        // A torn length must not turn into a huge allocation
+        if (length > size - good - kHeaderSize) break;
+        payload.resize(length);
+        if (!in.read(payload.data(), length) || checksum(recordSeq, payload.data(), length) != crc) break;
+        json ops = json::from_cbor(payload.begin(), payload.end(), true, false);
+        if (ops.is_discarded()) break;
+        if (recordSeq > seq) {
+            applyOps(state, ops);
+            seq = recordSeq;
+        }
+        good += kHeaderSize + length;
+    }
+    return good;
+}
+
+// Highest sequence number in a journal, from the record headers alone
+uint64_t lastSeq(const string& file) {
+    ifstream in(file, ios::binary | ios::ate);
+    if (!in) return 0;
+    uint64_t size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    uint64_t last = 0, pos = 0;
+    char header[kHeaderSize];
+    while (in.read(header, kHeaderSize)) {
+        uint32_t length;
+        uint64_t recordSeq;
+        memcpy(&length, header, 4);
+        memcpy(&recordSeq, header + 8, 8);
+        if (length > size - pos - kHeaderSize) break;
+        last = max(last, recordSeq);
+        pos += kHeaderSize + length;
+        if (!in.seekg(length, ios::cur)) break;
+    }
+    return last;
+}
+
+uint64_t fileSize(const string& file) {
+    error_code ec;
+    auto size = fs::file_size(file, ec);
+    return ec ? 0 : size;
+}
+
+// Journals open in this process, so replace() can go through the owner
+mutex& registryMutex() {
+    static mutex m;
+    return m;
+}
+
+unordered_map<string, StateJournal*>& registry() {
+    static unordered_map<string, StateJournal*> journals;
+    return journals;
+}
+
+string registryKey(const string& path) {
+    error_code ec;
+    fs::path canonical = fs::weakly_canonical(path, ec);
+    return ec ? path : canonical.string();
+}
+
+int openLock(const string& path) {
+    string lock = path + ".lock";
+    int fd = ::open(lock.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) cerr << "StateJournal: cannot open " << lock << ": " << strerror(errno) << "\n";
+    return fd;
+}
+
+// flock() on <path>.lock, which keeps processes sharing the state files
+// from interleaving. Without a lock file it degrades to no locking.
+class FileLock {
+public:
+    FileLock(int fd, int op) : fd_(fd) { acquire(op); }
+    FileLock(const string& path, int op) : fd_(openLock(path)), owned_(true) { acquire(op); }
+    ~FileLock() {
+        if (fd_ < 0) return;
+        ::flock(fd_, LOCK_UN);
+        if (owned_) ::close(fd_);
+    }
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+private:
+    void acquire(int op) {
+        while (fd_ >= 0 && ::flock(fd_, op) != 0) {
+            if (errno == EINTR) continue;
+            cerr << "StateJournal: cannot lock: " << strerror(errno) << "\n";
+            break;
+        }
+    }
+    int fd_;
+    bool owned_ = false;
+};
+}
+
+StateJournal::Options StateJournal::Options::fromEnvironment() {
+    Options options;
+    if (const char* env = getenv("FLOWFORGE_STATE_FSYNC")) {
+        string mode = env;
+        if (mode == "always") options.fsync = Fsync::Always;
+        else if (mode == "never") options.fsync = Fsync::Never;
+        else if (mode != "interval") cerr << "Ignoring invalid FLOWFORGE_STATE_FSYNC value '" << mode << "'\n";
+    }
+    auto number = [](const char* name, uint64_t fallback) -> uint64_t {
+        const char* env = getenv(name);
+        if (!env) return fallback;
+        try {
+            return stoull(env);
+        } catch (...) {
+            cerr << "Ignoring invalid " << name << " value '" << env << "'\n";
+            return fallback;
+        }
+    };
+    options.interval = chrono::milliseconds(max<uint64_t>(1, number("FLOWFORGE_STATE_FSYNC_MS", 200)));
+    options.compactBytes = number("FLOWFORGE_STATE_COMPACT_KB", 1024) * 1024;
+    return options;
+}
+
+json StateJournal::set(const string& pointer, json value) {
+    return json{ {"op", "set"}, {"path", pointer}, {"value", std::move(value)} };
+}
+
+json StateJournal::add(const string& pointer, double amount) {
+    return json{ {"op", "add"}, {"path", pointer}, {"value", amount} };
+}
+
+json StateJournal::push(const string& pointer, json value, size_t keep) {
+    return json{ {"op", "push"}, {"path", pointer}, {"value", std::move(value)}, {"keep", keep} };
+}
+
+string StateJournal::escape(const string& token) {
+    string out;
+    out.reserve(token.size());
+    for (char c : token) {
+        if (c == '~') out += "~0";
+        else if (c == '/') out += "~1";
+        else out += c;
+    }
+    return out;
+}
+
+json StateJournal::load(const string& path) {
+    FileLock guard(path, LOCK_SH);
+    uint64_t seq;
+    json state = loadSnapshot(path, seq);
+    // A compaction that did not finish leaves its input next to the new journal
+    replay(path + ".journal.old", state, seq);
+    replay(path + ".journal", state, seq);
+    return state;
+}
+
+bool StateJournal::replace(const string& path, const json& state) {
+    {
+        // A live journal would keep appending to the file we unlink
+        lock_guard<mutex> lock(registryMutex());
+        auto it = registry().find(registryKey(path));
+        if (it != registry().end()) return it->second->reset(state);
+    }
+    FileLock guard(path, LOCK_EX);
+    // Stamped with the last existing record so none of them is replayed on
+    // top if we stop before the journal is removed
+    uint64_t seq = max(lastSeq(path + ".journal.old"), lastSeq(path + ".journal"));
+    json snapshot = state.is_object() ? state : json::object();
+    snapshot[kSeqKey] = seq;
+    if (!JSONParser::writeFile(path, snapshot)) {
+        cerr << "StateJournal: cannot write " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    ::unlink((path + ".journal.old").c_str());
+    ::unlink((path + ".journal").c_str());
+    return true;
+}
+
+StateJournal::StateJournal(string path, Options options)
+    : path_(std::move(path)), options_(options) {
+    error_code ec;
+    fs::path parent = fs::path(path_).parent_path();
+    if (!parent.empty()) fs::create_directories(parent, ec);
+
+    lockFd_ = openLock(path_);
+    FileLock guard(lockFd_, LOCK_EX);
+    bool corrupt = false;
+    base_ = loadSnapshot(path_, lastSeq_, &corrupt);
+    if (corrupt) {
+        // The next compaction would replace it; keep it for inspection
+        string aside = path_ + ".corrupt";
+        if (::rename(path_.c_str(), aside.c_str()) == 0) cerr << "StateJournal: moved it to " << aside << "\n";
+    }
+    string old = path_ + ".journal.old";
+    bool unfinished = fs::exists(old, ec);
+    replay(old, base_, lastSeq_);
+    offset_ = readJournal(0);
+    if (unfinished) {
+        // Finish the interrupted compaction before appending anything. The
+        // journal is unlinked rather than truncated so that processes still
+        // holding it notice the swap.
+        json snapshot = base_;
+        snapshot[kSeqKey] = lastSeq_;
+        if (JSONParser::writeFile(path_, snapshot)) {
+            ::unlink(old.c_str());
+            ::unlink((path_ + ".journal").c_str());
+            offset_ = 0;
+        } else {
+            compactionFailed_ = true;
+        }
+    }
+    openJournal();
+    state_ = base_;
+    writer_ = thread([this] { run(); });
+    lock_guard<mutex> lock(registryMutex());
+    registry().emplace(registryKey(path_), this);
+}
+
+StateJournal::~StateJournal() {
+    {
+        lock_guard<mutex> lock(registryMutex());
+        auto it = registry().find(registryKey(path_));
+        if (it != registry().end() && it->second == this) registry().erase(it);
+    }
+    {
+        lock_guard<mutex> lock(mtx_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    if (fd_ >= 0) ::close(fd_);
+    if (lockFd_ >= 0) ::close(lockFd_);
+}
+
+void StateJournal::openJournal() {
+    string journal = path_ + ".journal";
+    fd_ = ::open(journal.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) cerr << "StateJournal: cannot open " << journal << ": " << strerror(errno) << "\n";
+}
+
+// Inter-process lock held. Folds the journal from `from` on into base_ and
+// cuts off a torn tail, which only a crashed writer can leave behind.
+// Returns the new end of the journal.
+uint64_t StateJournal::readJournal(uint64_t from) {
+    string journal = path_ + ".journal";
+    uint64_t good = replay(journal, base_, lastSeq_, from);
+    uint64_t size = fileSize(journal);
+    if (good < size) {
+        cerr << "StateJournal: discarding " << (size - good) << " bytes of torn records at the end of " << journal << "\n";
+        if (::truncate(journal.c_str(), static_cast<off_t>(good)) != 0) {
+            cerr << "StateJournal: cannot truncate " << journal << ": " << strerror(errno) << "\n";
+        }
+    }
+    return good;
+}
+
+// Writer thread, inter-process lock held. Rebuilds base_ from the files
+// after another process swapped the journal out from under us.
+void StateJournal::reload() {
+    if (fd_ >= 0) ::close(fd_);
+    base_ = loadSnapshot(path_, lastSeq_);
+    replay(path_ + ".journal.old", base_, lastSeq_);
+    offset_ = readJournal(0);
+    openJournal();
+}
+
+// Writer thread, inter-process lock held. Returns true if other processes
+// changed the state since we last looked.
+bool StateJournal::catchUp() {
+    string journal = path_ + ".journal";
+    struct stat onDisk, ours;
+    bool same = fd_ >= 0 && ::stat(journal.c_str(), &onDisk) == 0 && ::fstat(fd_, &ours) == 0 &&
+                onDisk.st_dev == ours.st_dev && onDisk.st_ino == ours.st_ino &&
+                static_cast<uint64_t>(onDisk.st_size) >= offset_;
+    if (!same) {
+        reload();
+        return true;
+    }
+    if (static_cast<uint64_t>(onDisk.st_size) == offset_) return false;
+    offset_ = readJournal(offset_);
+    return true;
+}
+
+void StateJournal::apply(json ops) {
+    if (!ops.is_array()) ops = json::array({ std::move(ops) });
+    // Encoded outside the lock; record numbers are assigned by the writer
+    vector<uint8_t> payload = json::to_cbor(ops);
+    unique_lock<mutex> lock(mtx_);
+    applyOps(state_, ops);
+    uint64_t seq = ++seq_;
+    pending_.push_back({ std::move(ops), std::move(payload), false, seq });
+    if (options_.fsync != Fsync::Always) return;
+    wake_.notify_one();
+    waitDurable(lock, seq);
+}
+
+// Until a write that includes `seq` succeeds or fails
+void StateJournal::waitDurable(unique_lock<mutex>& lock, uint64_t seq) {
+    durable_.wait(lock, [&] { return durableSeq_ >= seq || failedUpto_ >= seq; });
+    if (durableSeq_ < seq) {
+        throw runtime_error("StateJournal: cannot write " + path_ + ".journal (" + writeError_ + "); will retry");
+    }
+}
+
+// mtx_ held. What we know is on disk plus what is still queued here
+void StateJournal::rebuildState() {
+    state_ = base_;
+    for (const Pending& p : pending_) {
+        if (p.reset) state_ = p.ops;
+        else applyOps(state_, p.ops);
+    }
+}
+
+bool StateJournal::reset(json state) {
+    if (!state.is_object()) state = json::object();
+    unique_lock<mutex> lock(mtx_);
+    pending_.clear();
+    state_ = state;
+    uint64_t seq = ++seq_;
+    pending_.push_back({ std::move(state), {}, true, seq });
+    syncRequested_ = true;
+    wake_.notify_one();
+    // A newer reset that superseded this one answers for both
+    durable_.wait(lock, [&] { return resetSeq_ >= seq; });
+    return resetOk_;
+}
+
+json StateJournal::state() const {
+    lock_guard<mutex> lock(mtx_);
+    return state_;
+}
+
+void StateJournal::sync() {
+    unique_lock<mutex> lock(mtx_);
+    uint64_t target = seq_;
+    if (durableSeq_ >= target) return;
+    syncRequested_ = true;
+    wake_.notify_one();
+    waitDurable(lock, target);
+}
+
+void StateJournal::run() {
+    unique_lock<mutex> lock(mtx_);
+    while (true) {
+        // "always" commits as soon as something is pending; records that
+        // arrive during the fsync form the next group. Otherwise records
+        // are collected for one interval. After a failed write, the retry
+        // waits one interval either way.
+        if (options_.fsync == Fsync::Always && !failing_) {
+            wake_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        } else {
+            wake_.wait_for(lock, options_.interval, [this] { return stop_ || (syncRequested_ && !failing_); });
+        }
+        syncRequested_ = false;
+        bool stopping = stop_;
+        if (!pending_.empty()) {
+            vector<Pending> batch;
+            batch.swap(pending_);
+            uint64_t upto = seq_;
+            lock.unlock();
+            bool changed = false, rewritten = false;
+            bool ok = commit(batch, changed, rewritten);
+            int err = errno;
+            lock.lock();
+            bool resetFailed = batch.front().reset && !rewritten;
+            if (batch.front().reset) {
+                // Settled either way; only the records after it are retried
+                resetSeq_ = batch.front().seq;
+                resetOk_ = rewritten;
+                if (!ok) batch.erase(batch.begin());
+            }
+            if (!ok && batch.empty()) {
+                durableSeq_ = upto;
+            } else if (!ok) {
+                // Keep the group, ahead of anything applied since, unless a
+                // reset queued meanwhile has superseded it
+                if (pending_.empty() || !pending_.front().reset) {
+                    pending_.insert(pending_.begin(), make_move_iterator(batch.begin()),
+                                    make_move_iterator(batch.end()));
+                }
+                // Records behind a failed reset were not tried yet
+                if (!resetFailed) {
+                    failing_ = true;
+                    failedUpto_ = upto;
+                    writeError_ = strerror(err);
+                }
+            } else {
+                failing_ = false;
+                durableSeq_ = upto;
+            }
+            // Other processes' records go under ours, in file order; a
+            // failed reset no longer masks what came before it
+            if (changed || resetFailed) rebuildState();
+            durable_.notify_all();
+        }
+        if (stopping && !pending_.empty() && failing_) {
+            cerr << "StateJournal: giving up on " << pending_.size() << " unwritten changes to " << path_ << "\n";
+            break;
+        }
+        if (stopping && pending_.empty()) break;
+    }
+}
+
+// Writer thread. Appends one group under the inter-process lock, numbered
+// after whatever the other processes appended first, which sets `changed`.
+// A leading reset is written first and sets `rewritten`. Returns false with
+// errno set if the group is not on disk.
+bool StateJournal::commit(const vector<Pending>& batch, bool& changed, bool& rewritten) {
+    FileLock guard(lockFd_, LOCK_EX);
+    changed = catchUp();
+    auto first = batch.begin();
+    if (first != batch.end() && first->reset) {
+        rewritten = rewrite((first++)->ops);
+        if (!rewritten) return false;
+    }
+    if (first == batch.end()) return true;
+    string records;
+    uint64_t seq = lastSeq_;
+    for (auto p = first; p != batch.end(); ++p) encodeRecord(records, ++seq, p->payload);
+    bool ok = fd_ >= 0 && writeAll(fd_, records.data(), records.size());
+    if (ok && options_.fsync != Fsync::Never) ok = ::fdatasync(fd_) == 0;
+    if (!ok) {
+        int err = fd_ >= 0 ? errno : EBADF;
+        cerr << "StateJournal: cannot write " << path_ << ".journal: " << strerror(err) << "\n";
+        // Leave no partial record for the next append to land behind
+        if (fd_ >= 0 && ::ftruncate(fd_, static_cast<off_t>(offset_)) != 0) {
+            cerr << "StateJournal: cannot truncate " << path_ << ".journal: " << strerror(errno) << "\n";
+        }
+        errno = err;
+        return false;
+    }
+    for (auto p = first; p != batch.end(); ++p) applyOps(base_, p->ops);
+    lastSeq_ = seq;
+    offset_ += records.size();
+    if (!compactionFailed_ && offset_ >= options_.compactBytes) compact();
+    return true;
+}
+
+// Writer thread, inter-process lock held, caught up. The snapshot is
+// stamped with the last record on disk so none of them is replayed on top.
+bool StateJournal::rewrite(const json& state) {
+    json snapshot = state;
+    snapshot[kSeqKey] = lastSeq_;
+    if (!JSONParser::writeFile(path_, snapshot)) {
+        int err = errno;
+        cerr << "StateJournal: cannot write " << path_ << ": " << strerror(err) << "\n";
+        errno = err;
+        return false;
+    }
+    ::unlink((path_ + ".journal.old").c_str());
+    ::unlink((path_ + ".journal").c_str());
+    if (fd_ >= 0) ::close(fd_);
+    openJournal();
+    base_ = state;
+    offset_ = 0;
+    return true;
+}
+
+// Writer thread, inter-process lock held. The journal is renamed aside
+// first, so a crash before the new snapshot lands is finished on the next
+// open; other processes see a new journal file and reload.
+void StateJournal::compact() {
+    string journal = path_ + ".journal";
+    string old = journal + ".old";
+    if (::rename(journal.c_str(), old.c_str()) != 0) return;
+    json snapshot = base_;
+    snapshot[kSeqKey] = lastSeq_;
+    if (JSONParser::writeFile(path_, snapshot)) {
+        ::unlink(old.c_str());
+    } else {
+        cerr << "StateJournal: compaction of " << path_ << " failed: " << strerror(errno) << "\n";
+        compactionFailed_ = true;
+    }
+    if (fd_ >= 0) ::close(fd_);
+    openJournal();
+    offset_ = 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "utils/json.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Engine state (data/state.json) kept as a JSON snapshot plus an
+// append-only journal of changes next to it (<path>.journal). Each apply()
+// appends one record: u32 payload length, u32 CRC-32 of sequence number and
+// payload, u64 sequence number, then the ops as CBOR. Opening replays the
+// snapshot and every intact journal record after it; a torn tail is cut off.
+//
+// Records are written by one thread in groups. FLOWFORGE_STATE_FSYNC picks
+// the durability: "always" returns from apply() once its group is fsynced,
+// "interval" (default) writes and fsyncs every FLOWFORGE_STATE_FSYNC_MS
+// (200), "never" leaves flushing to the OS. Once the journal passes
+// FLOWFORGE_STATE_COMPACT_KB (1024) it is folded into a new snapshot.
+//
+// Several processes may share the files (a daemon plus `flowforge run` from
+// cron): opening, every group append and compaction hold flock() on
+// <path>.lock. Before appending, a writer replays what the others appended
+// and numbers its records after theirs; state() includes their changes as
+// of this process's last write.
+class StateJournal {
+public:
+    enum class Fsync { Always, Interval, Never };
+    struct Options {
+        Fsync fsync = Fsync::Interval;
+        std::chrono::milliseconds interval{200};
+        uint64_t compactBytes = 1024 * 1024;
+        static Options fromEnvironment();
+    };
+
+    explicit StateJournal(std::string path, Options options = Options::fromEnvironment());
+    // Writes everything applied so far
+    ~StateJournal();
+
+    // Ops are built with set/add/push and applied atomically, in order
+    void apply(nlohmann::json ops);
+    // Sets the value at a JSON pointer, creating parents
+    static nlohmann::json set(const std::string& pointer, nlohmann::json value);
+    // Adds to the number at a JSON pointer (missing counts as 0)
+    static nlohmann::json add(const std::string& pointer, double amount);
+    // Appends to the array at a JSON pointer, keeping the last `keep` entries
+    static nlohmann::json push(const std::string& pointer, nlohmann::json value, size_t keep);
+    // Escapes one pointer token ("a/b" -> "a~1b")
+    static std::string escape(const std::string& token);
+
+    nlohmann::json state() const;
+    // Blocks until every applied change is on disk (fsynced unless "never").
+    // Throws std::runtime_error if the journal cannot be written; the
+    // changes stay queued and the writer keeps retrying. apply() does the
+    // same in "always" mode.
+    void sync();
+
+    // Replaces the whole state: new snapshot, journal discarded. Changes
+    // applied before it and not yet written are dropped. Returns once the
+    // snapshot is on disk, or false (after reporting why) if it could not be
+    // written; a failed reset is not retried.
+    bool reset(nlohmann::json state);
+
+    // Read-only replay of snapshot + journal
+    static nlohmann::json load(const std::string& path);
+    // reset() on the journal this process has open on `path`, otherwise
+    // the same directly on the files
+    static bool replace(const std::string& path, const nlohmann::json& state);
+
+    StateJournal(const StateJournal&) = delete;
+    StateJournal& operator=(const StateJournal&) = delete;
+private:
+    struct Pending {
+        nlohmann::json ops;           // or the new state, for a reset
+        std::vector<uint8_t> payload; // ops as CBOR
+        bool reset = false;           // only ever first in line
+        uint64_t seq = 0;             // this process's apply/reset count
+    };
+
+    void run();
+    bool commit(const std::vector<Pending>& batch, bool& changed, bool& rewritten);
+    void rebuildState();
+    void waitDurable(std::unique_lock<std::mutex>& lock, uint64_t seq);
+    bool catchUp();
+    bool rewrite(const nlohmann::json& state);
+    void reload();
+    uint64_t readJournal(uint64_t from);
+    void compact();
+    void openJournal();
+
+    const std::string path_;
+    const Options options_;
+    mutable std::mutex mtx_;
+    std::condition_variable wake_;
+    std::condition_variable durable_;
+    nlohmann::json state_;      // base_ plus everything applied here since
+    uint64_t seq_ = 0;          // applies made by this process
+    uint64_t durableSeq_ = 0;   // of those, written (and fsynced, per policy)
+    std::vector<Pending> pending_; // not handed to the writer yet
+    bool syncRequested_ = false;
+    bool stop_ = false;
+    bool failing_ = false;      // the last write failed; pending_ is retried
+    uint64_t failedUpto_ = 0;   // last apply covered by a failed write
+    std::string writeError_;
+    uint64_t resetSeq_ = 0;     // last reset that was settled...
+    bool resetOk_ = false;      // ...and whether its snapshot was written
+
+    // Writer thread only (and the constructor/destructor)
+    nlohmann::json base_;       // snapshot plus the journal up to offset_
+    uint64_t lastSeq_ = 0;      // highest record number in base_
+    uint64_t offset_ = 0;       // bytes of the journal folded into base_
+    int fd_ = -1;
+    int lockFd_ = -1;
+    bool compactionFailed_ = false;
+    std::thread writer_;
+};
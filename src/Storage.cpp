@@ -1,9 +1,88 @@
 #include "Storage.h"
-#include "utils/JSONParser.h"
+#include "StateJournal.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 using namespace std;
-void Storage::saveState(const nlohmann::json& state, const string& path) {
-    JSONParser::writeFile(path, state);
+
+namespace {
+class Checkpointer {
+public:
+    static Checkpointer& instance() {
+        static Checkpointer checkpointer;
+        return checkpointer;
+    }
+
+    bool save(nlohmann::json state, const string& path) {
+        unique_lock<mutex> lock(mtx_);
+        Slot& slot = slots_[path];
+        // An older state still waiting is simply replaced
+        slot.state = std::move(state);
+        uint64_t ticket = ++slot.queued;
+        if (!slot.pending) {
+            slot.pending = true;
+            queue_.push_back(path);
+            wake_.notify_one();
+        }
+        written_.wait(lock, [&] { return slot.written >= ticket; });
+        // A later write that already replaced ours answers for it
+        return slot.ok;
+    }
+
+    ~Checkpointer() {
+        {
+            lock_guard<mutex> lock(mtx_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+private:
+    struct Slot {
+        nlohmann::json state;
+        uint64_t queued = 0;  // saves requested
+        uint64_t written = 0; // saves covered by a finished write
+        bool ok = false;      // outcome of that write
+        bool pending = false;
+    };
+
+    Checkpointer() : writer_([this] { run(); }) {}
+
+    void run() {
+        unique_lock<mutex> lock(mtx_);
+        while (true) {
+            wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            string path = std::move(queue_.front());
+            queue_.pop_front();
+            Slot& slot = slots_[path];
+            slot.pending = false;
+            nlohmann::json state = std::move(slot.state);
+            uint64_t upto = slot.queued;
+            lock.unlock();
+            bool ok = StateJournal::replace(path, state);
+            lock.lock();
+            slot.ok = ok;
+            slot.written = upto;
+            written_.notify_all();
+        }
+    }
+
+    mutex mtx_;
+    condition_variable wake_;
+    condition_variable written_;
+    unordered_map<string, Slot> slots_;
+    deque<string> queue_;
+    bool stop_ = false;
+    thread writer_;
+};
+}
+
+bool Storage::saveState(const nlohmann::json& state, const string& path) {
+    return Checkpointer::instance().save(state, path);
 }
 nlohmann::json Storage::loadState(const string& path) {
-    return JSONParser::parseFile(path);
+    return StateJournal::load(path);
 }
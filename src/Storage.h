@@ -3,6 +3,11 @@
 #include "utils/json.hpp"
 class Storage {
 public:
-    static void saveState(const nlohmann::json& state, const std::string& path);
+    // Replaces the whole state at `path` (see StateJournal::replace; a
+    // journal open on it does the write) and returns once it is on disk,
+    // or false if it could not be written. One thread does all the
+    // writing; saves that queue up behind a write in progress coalesce into
+    // a single write of the newest state.
+    static bool saveState(const nlohmann::json& state, const std::string& path);
     static nlohmann::json loadState(const std::string& path);
 };
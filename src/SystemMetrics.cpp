@@ -0,0 +1,171 @@
+#include "SystemMetrics.h"
+#include <sys/statvfs.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#ifdef __APPLE__
+#include <mach/mach.h>  // For macOS memory info
+#endif
+using namespace std;
+
+namespace {
+double diskUsed(const string& path) {
+    struct statvfs stat;
+    if (statvfs(path.c_str(), &stat) != 0 || stat.f_blocks == 0) return -1;
+    return 1.0 - (double)stat.f_bavail / stat.f_blocks;
+}
+
+double memoryUsed() {
+#ifdef __APPLE__
+    // macOS memory info using mach
+    mach_msg_type_number_t count = HOST_VM_INFO_COUNT;
+    vm_statistics_data_t vmstat;
+    if (host_statistics(mach_host_self(), HOST_VM_INFO, (host_info_t)&vmstat, &count) != KERN_SUCCESS) {
+        return -1;
+    }
+    return 1.0 - (double)vmstat.free_count / (vmstat.free_count + vmstat.active_count + vmstat.inactive_count + vmstat.wire_count);
+#else
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (!f) return -1;
+    char line[256];
+    unsigned long long total = 0, available = 0, value;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemTotal: %llu kB", &value) == 1) total = value;
+        else if (sscanf(line, "MemAvailable: %llu kB", &value) == 1) available = value;
+    }
+    fclose(f);
+    if (total == 0) return -1;
+    return 1.0 - (double)available / total;
+#endif
+}
+}
+
+SystemMetrics& SystemMetrics::instance() {
+    static SystemMetrics inst;
+    return inst;
+}
+
+SystemMetrics::SystemMetrics() {
+    for (auto& d : disks_) d.store(-1, memory_order_relaxed);
+    if (const char* env = getenv("FLOWFORGE_METRICS_INTERVAL_MS")) {
+        try {
+            interval_ = chrono::milliseconds(max(10L, stol(env)));
+        } catch (...) {
+            cerr << "Ignoring invalid FLOWFORGE_METRICS_INTERVAL_MS value '" << env << "'\n";
+        }
+    }
+    // The first snapshot is taken synchronously so early readers see real
+    // values; CPU starts as the average since boot
+    {
+        lock_guard<mutex> lock(mtx_);
+        sample();
+    }
+    thread_ = thread([this] { run(); });
+}
+
+SystemMetrics::~SystemMetrics() {
+    {
+        lock_guard<mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+size_t SystemMetrics::watchMount(const string& path) {
+    lock_guard<mutex> lock(mtx_);
+    for (size_t i = 0; i < mounts_.size(); ++i) {
+        if (mounts_[i] == path) return i;
+    }
+    if (mounts_.size() == kMaxMounts) {
+        throw length_error("more than " + to_string(kMaxMounts) + " distinct disk mounts in rules");
+    }
+    mounts_.push_back(path);
+    // Fill the new slot right away rather than waiting for the next cycle
+    uint64_t s = seq_.load(memory_order_relaxed);
+    seq_.store(s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    disks_[mounts_.size() - 1].store(diskUsed(path), memory_order_relaxed);
+    seq_.store(s + 2, memory_order_release);
+    return mounts_.size() - 1;
+}
+
+double SystemMetrics::sampleCpu() {
+    FILE* f = fopen("/proc/stat", "r");
+    if (!f) return -1;
+    unsigned long long user, nice, system, idle, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(f);
+    if (n < 4) return -1;
+    uint64_t total = user + nice + system + idle + iowait + irq + softirq + steal;
+    uint64_t busy = total - idle - iowait;
+    uint64_t dTotal = total - lastTotal_;
+    uint64_t dBusy = busy - lastBusy_;
+    lastTotal_ = total;
+    lastBusy_ = busy;
+    if (dTotal == 0) return cpu_.load(memory_order_relaxed);
+    return (double)dBusy / dTotal;
+}
+
+// Caller holds mtx_, which also makes this the only seqlock writer
+void SystemMetrics::sample() {
+    double cpu = sampleCpu();
+    double memory = memoryUsed();
+    vector<double> disks;
+    disks.reserve(mounts_.size());
+    for (const auto& m : mounts_) disks.push_back(diskUsed(m));
+    publish(cpu, memory, disks);
+}
+
+void SystemMetrics::publish(double cpu, double memory, const vector<double>& disks) {
+    uint64_t s = seq_.load(memory_order_relaxed);
+    seq_.store(s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    cpu_.store(cpu, memory_order_relaxed);
+    memory_.store(memory, memory_order_relaxed);
+    for (size_t i = 0; i < disks.size(); ++i) disks_[i].store(disks[i], memory_order_relaxed);
+    seq_.store(s + 2, memory_order_release);
+}
+
+void SystemMetrics::run() {
+    unique_lock<mutex> lock(mtx_);
+    while (!cv_.wait_for(lock, interval_, [this] { return stop_; })) {
+        sample();
+    }
+}
+
+template<class F>
+auto SystemMetrics::read(F&& field) const {
+    while (true) {
+        uint64_t before = seq_.load(memory_order_acquire);
+        auto value = field();
+        atomic_thread_fence(memory_order_acquire);
+        if (!(before & 1) && seq_.load(memory_order_relaxed) == before) return value;
+    }
+}
+
+SystemMetrics::Snapshot SystemMetrics::snapshot() const {
+    return read([this] {
+        Snapshot s;
+        s.cpu = cpu_.load(memory_order_relaxed);
+        s.memory = memory_.load(memory_order_relaxed);
+        for (size_t i = 0; i < kMaxMounts; ++i) s.disks[i] = disks_[i].load(memory_order_relaxed);
+        return s;
+    });
+}
+
+double SystemMetrics::cpu() const {
+    return cpu_.load(memory_order_acquire);
+}
+
+double SystemMetrics::memory() const {
+    return memory_.load(memory_order_acquire);
+}
+
+double SystemMetrics::disk(size_t mount) const {
+    return mount < kMaxMounts ? disks_[mount].load(memory_order_acquire) : -1;
+}
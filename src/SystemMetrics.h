@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process-wide sampler for the host metrics rules look at. A background
+// thread reads /proc/stat, /proc/meminfo and statvfs for every registered
+// mount at a fixed cadence (FLOWFORGE_METRICS_INTERVAL_MS, default 1000)
+// and publishes them through a seqlock, so rule evaluation never issues a
+// syscall and the sampling cost does not grow with the number of rules.
+// Values are used fractions in [0, 1], or -1 when unavailable.
+class SystemMetrics {
+public:
+    static constexpr size_t kMaxMounts = 32;
+
+    struct Snapshot {
+        double cpu = -1;
+        double memory = -1;
+        std::array<double, kMaxMounts> disks;
+    };
+
+    static SystemMetrics& instance();
+
+    // Index of `path` in Snapshot::disks, sampled from now on. Paths beyond
+    // kMaxMounts throw std::length_error.
+    size_t watchMount(const std::string& path);
+
+    Snapshot snapshot() const;
+    double cpu() const;
+    double memory() const;
+    double disk(size_t mount) const;
+
+    ~SystemMetrics();
+    SystemMetrics(const SystemMetrics&) = delete;
+    SystemMetrics& operator=(const SystemMetrics&) = delete;
+private:
+    SystemMetrics();
+    void run();
+    void sample();
+    double sampleCpu();
+    template<class F> auto read(F&& field) const;
+    void publish(double cpu, double memory, const std::vector<double>& disks);
+
+    // Seqlock: odd while the sampler is writing
+    std::atomic<uint64_t> seq_{0};
+    std::atomic<double> cpu_{-1};
+    std::atomic<double> memory_{-1};
+    std::array<std::atomic<double>, kMaxMounts> disks_;
+
+    std::mutex mtx_; // guards mounts_ and the sampler-side state below
+    std::condition_variable cv_;
+    std::vector<std::string> mounts_;
+    uint64_t lastBusy_ = 0;
+    uint64_t lastTotal_ = 0;
+    std::chrono::milliseconds interval_{1000};
+    bool stop_ = false;
+    std::thread thread_;
+};
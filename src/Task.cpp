@@ -0,0 +1,90 @@
+#include "Task.h"
+#include <condition_variable>
+#include <mutex>
+using namespace std;
+
+namespace detail {
+
+namespace {
+// Per-thread free list of task blocks. Blocks are returned to whichever
+// thread drops the last reference, which for the usual enqueue-then-get
+// pattern is the submitting thread.
+constexpr size_t kMaxCachedBlocks = 1024;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+enum CacheState { Unused, Alive, Dead };
+thread_local CacheState cacheState = Unused;
+
+struct BlockCache {
+    FreeBlock* head = nullptr;
+    size_t count = 0;
+    BlockCache() { cacheState = Alive; }
+    ~BlockCache() {
+        cacheState = Dead;
+        while (head) {
+            FreeBlock* next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+};
+
+// Null once the thread's cache has been torn down (thread exit)
+BlockCache* localCache() {
+    if (cacheState == Dead) return nullptr;
+    static thread_local BlockCache cache;
+    return &cache;
+}
+
+struct Stripe {
+    mutex mtx;
+    condition_variable cv;
+};
+constexpr size_t kStripes = 64;
+Stripe stripes[kStripes];
+
+Stripe& stripeFor(const void* key) {
+    auto bits = reinterpret_cast<uintptr_t>(key);
+    return stripes[(bits >> 6) % kStripes];
+}
+}
+
+void* allocateTaskBlock() {
+    BlockCache* cache = localCache();
+    if (cache && cache->head) {
+        FreeBlock* block = cache->head;
+        cache->head = block->next;
+        --cache->count;
+        return block;
+    }
+    return ::operator new(kTaskBlockSize);
+}
+
+void freeTaskBlock(void* block) {
+    BlockCache* cache = localCache();
+    if (cache && cache->count < kMaxCachedBlocks) {
+        auto* node = static_cast<FreeBlock*>(block);
+        node->next = cache->head;
+        cache->head = node;
+        ++cache->count;
+        return;
+    }
+    ::operator delete(block);
+}
+
+void parkUntilReady(const atomic<uint8_t>& status, const void* key) {
+    Stripe& stripe = stripeFor(key);
+    unique_lock<mutex> lock(stripe.mtx);
+    stripe.cv.wait(lock, [&] { return status.load(memory_order_acquire) == TaskBase::Ready; });
+}
+
+void wakeWaiters(const void* key) {
+    Stripe& stripe = stripeFor(key);
+    lock_guard<mutex> lock(stripe.mtx);
+    stripe.cv.notify_all();
+}
+
+}
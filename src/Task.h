@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Task nodes for ThreadPool. A submitted callable, its result slot and the
+// completion flag live in one node owned by the TaskFuture; the worker only
+// touches it until it publishes the result. Nodes up to kTaskBlockSize bytes
+// come from a per-thread free list, so steady-state submission does not
+// touch malloc.
+namespace detail {
+
+constexpr size_t kTaskBlockSize = 192;
+
+void* allocateTaskBlock();
+void freeTaskBlock(void* block);
+
+// Blocking is done on a small global table of mutex/condvar stripes keyed by
+// the node address, so nodes themselves carry only an atomic status byte.
+void parkUntilReady(const std::atomic<uint8_t>& status, const void* key);
+void wakeWaiters(const void* key);
+// Lets a pool worker run other queued work while it waits on a result
+bool helpRunPendingTask();
+
+class TaskBase {
+public:
+    enum Status : uint8_t { Pending = 0, Waiting = 1, Ready = 2, Detached = 3 };
+
+    // Executes the callable and publishes the result. The worker must not
+    // touch the node afterwards: it may already be freed by the future.
+    virtual void run() = 0;
+
+    bool ready() const { return status_.load(std::memory_order_acquire) == Ready; }
+
+    void wait() {
+        while (!ready()) {
+            if (helpRunPendingTask()) continue;
+            uint8_t expected = Pending;
+            status_.compare_exchange_strong(expected, Waiting, std::memory_order_acq_rel);
+            parkUntilReady(status_, this);
+        }
+    }
+
+    // Frees a finished node; an unfinished one is handed over to the worker,
+    // which frees it after running (fire-and-forget submissions).
+    void detach() {
+        uint8_t current = status_.load(std::memory_order_acquire);
+        while (current != Ready) {
+            if (status_.compare_exchange_weak(current, Detached, std::memory_order_acq_rel)) return;
+        }
+        destroy();
+    }
+
+    void destroy() {
+        bool pooled = pooled_;
+        this->~TaskBase();
+        if (pooled) freeTaskBlock(this);
+        else ::operator delete(this);
+    }
+
+protected:
+    TaskBase() = default;
+    virtual ~TaskBase() = default;
+
+    void markReady() {
+        uint8_t previous = status_.exchange(Ready, std::memory_order_acq_rel);
+        if (previous == Waiting) {
+            wakeWaiters(this);
+        } else if (previous == Detached) {
+            destroy();
+        }
+    }
+
+private:
+    template<class Node, class F>
+    friend Node* makeTaskNode(F&& fn);
+
+    bool pooled_ = false;
+    std::atomic<uint8_t> status_{Pending};
+};
+
+template<class R>
+class TaskState : public TaskBase {
+public:
+    R take() {
+        if (error_) std::rethrow_exception(error_);
+        if constexpr (!std::is_void_v<R>) return std::move(*value_);
+    }
+protected:
+    template<class F>
+    void complete(F& fn) {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                fn();
+            } else {
+                value_.emplace(fn());
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+        markReady();
+    }
+private:
+    using Slot = std::conditional_t<std::is_void_v<R>, char, R>;
+    std::optional<Slot> value_;
+    std::exception_ptr error_;
+};
+
+template<class F, class R>
+class TaskNode final : public TaskState<R> {
+public:
+    explicit TaskNode(F&& fn) : fn_(std::move(fn)) {}
+    void run() override { this->complete(fn_); }
+private:
+    F fn_;
+};
+
+template<class Node, class F>
+Node* makeTaskNode(F&& fn) {
+    if constexpr (sizeof(Node) <= kTaskBlockSize && alignof(Node) <= alignof(std::max_align_t)) {
+        void* block = allocateTaskBlock();
+        Node* node;
+        try {
+            node = new (block) Node(std::forward<F>(fn));
+        } catch (...) {
+            freeTaskBlock(block);
+            throw;
+        }
+        node->pooled_ = true;
+        return node;
+    } else {
+        static_assert(alignof(Node) <= alignof(std::max_align_t), "over-aligned task captures");
+        return new Node(std::forward<F>(fn));
+    }
+}
+
+}
+
+// Move-only handle to a result produced by ThreadPool::enqueue. Replaces
+// std::future without the separately allocated packaged_task shared state.
+template<class R>
+class TaskFuture {
+public:
+    TaskFuture() = default;
+    explicit TaskFuture(detail::TaskState<R>* state) : state_(state) {}
+    TaskFuture(TaskFuture&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
+    TaskFuture& operator=(TaskFuture&& other) noexcept {
+        if (this != &other) {
+            reset();
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+    TaskFuture(const TaskFuture&) = delete;
+    TaskFuture& operator=(const TaskFuture&) = delete;
+    ~TaskFuture() { reset(); }
+
+    bool valid() const { return state_ != nullptr; }
+    bool ready() const { return state_ && state_->ready(); }
+
+    void wait() const {
+        if (!state_) throw std::logic_error("TaskFuture has no state");
+        state_->wait();
+    }
+
+    // Blocks until the task finished, then returns its value or rethrows.
+    // Like std::future::get, it can be called once.
+    R get() {
+        wait();
+        detail::TaskState<R>* state = std::exchange(state_, nullptr);
+        struct Destroy {
+            detail::TaskState<R>* s;
+            ~Destroy() { s->destroy(); }
+        } guard{state};
+        return state->take();
+    }
+
+private:
+    void reset() {
+        if (state_) {
+            state_->detach();
+            state_ = nullptr;
+        }
+    }
+    detail::TaskState<R>* state_ = nullptr;
+};
@@ -1,31 +1,127 @@
 #include "ThreadPool.h"
 using namespace std;
 
+namespace {
+// Identifies the pool (and deque) owned by the current thread, if any
+thread_local ThreadPool* currentPool = nullptr;
+thread_local size_t currentIndex = 0;
+
+constexpr int kSpinRounds = 64;
+
+uint32_t nextRandom(uint32_t& seed) {
+    // xorshift32: cheap victim selection, quality does not matter here
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+}
+
 ThreadPool::ThreadPool(size_t threads) : stop(false) {
+    if (threads == 0) threads = 1;
+    workers.reserve(threads);
     for(size_t i = 0; i < threads; ++i)
-        workers.emplace_back([this] {
-            while(true) {
-                function<void()> task;
-                {
-                    unique_lock<mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock,
-                        [this]{ return this->stop || !this->tasks.empty(); });
-                    if(this->stop && this->tasks.empty())
-                        return;
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
-                task();
-            }
-        });
+        workers.push_back(make_unique<Worker>());
+    for(size_t i = 0; i < threads; ++i)
+        workers[i]->thread = thread([this, i] { workerLoop(i); });
 }
 
 ThreadPool::~ThreadPool() {
     {
-        unique_lock<mutex> lock(queue_mutex);
+        lock_guard<mutex> lock(sleepMutex);
         stop = true;
     }
     condition.notify_all();
-    for(thread &worker: workers)
-        worker.join();
-}
\ No newline at end of file
+    for(auto &worker: workers)
+        worker->thread.join();
+}
+
+void ThreadPool::submit(Task* task) {
+    if(stop.load(memory_order_relaxed)) {
+        throw runtime_error("enqueue on stopped ThreadPool");
+    }
+    if(currentPool == this) {
+        workers[currentIndex]->deque.push(task);
+    } else {
+        lock_guard<mutex> lock(injectMutex);
+        injected.push_back(task);
+    }
+    // Paired with the sleepers increment in workerLoop: either the sleeping
+    // worker sees the new count or we see it sleeping and wake it.
+    queued.fetch_add(1, memory_order_seq_cst);
+    if(sleepers.load(memory_order_seq_cst) > 0) {
+        lock_guard<mutex> lock(sleepMutex);
+        condition.notify_one();
+    }
+}
+
+ThreadPool::Task* ThreadPool::popInjected() {
+    lock_guard<mutex> lock(injectMutex);
+    if(injected.empty()) return nullptr;
+    Task* task = injected.front();
+    injected.pop_front();
+    return task;
+}
+
+ThreadPool::Task* ThreadPool::findTask(size_t index, uint32_t& seed) {
+    if(Task* task = workers[index]->deque.pop()) return task;
+    if(Task* task = popInjected()) return task;
+    size_t n = workers.size();
+    if(n < 2) return nullptr;
+    size_t start = nextRandom(seed) % n;
+    for(size_t k = 0; k < n; ++k) {
+        size_t victim = (start + k) % n;
+        if(victim == index) continue;
+        if(Task* task = workers[victim]->deque.steal()) return task;
+    }
+    return nullptr;
+}
+
+void ThreadPool::runTask(Task* task) {
+    queued.fetch_sub(1, memory_order_relaxed);
+    task->run();
+}
+
+bool ThreadPool::runPendingTask() {
+    ThreadPool* pool = currentPool;
+    if(!pool) return false;
+    thread_local uint32_t seed = 0x9e3779b9u;
+    Task* task = pool->findTask(currentIndex, seed);
+    if(!task) return false;
+    pool->runTask(task);
+    return true;
+}
+
+namespace detail {
+bool helpRunPendingTask() {
+    return ThreadPool::runPendingTask();
+}
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+    uint32_t seed = static_cast<uint32_t>(index * 2654435761u) | 1u;
+    int idleRounds = 0;
+    while(true) {
+        Task* task = findTask(index, seed);
+        if(task) {
+            idleRounds = 0;
+            runTask(task);
+            continue;
+        }
+        if(stop.load(memory_order_acquire) && queued.load(memory_order_acquire) == 0)
+            return;
+        if(++idleRounds < kSpinRounds) {
+            this_thread::yield();
+            continue;
+        }
+        idleRounds = 0;
+        unique_lock<mutex> lock(sleepMutex);
+        sleepers.fetch_add(1, memory_order_seq_cst);
+        condition.wait(lock, [this] {
+            return stop.load(memory_order_relaxed) || queued.load(memory_order_seq_cst) > 0;
+        });
+        sleepers.fetch_sub(1, memory_order_relaxed);
+    }
+}
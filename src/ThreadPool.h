@@ -1,37 +1,67 @@
 #pragma once
 #include <vector>
 #include <thread>
-#include <queue>
-#include <functional>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
-#include <future>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <stdexcept>
+#include "Task.h"
+#include "WorkStealingDeque.h"
+
+// Work-stealing executor. Every worker owns a Chase-Lev deque: tasks enqueued
+// from a worker go to the bottom of its own deque, tasks from other threads
+// go through a shared injection queue, and idle workers steal from the top
+// of randomly chosen victims before going to sleep.
 class ThreadPool {
 public:
     ThreadPool(size_t threads);
     ~ThreadPool();
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result_t<F, Args...>> {
+    auto enqueue(F&& f, Args&&... args) -> TaskFuture<typename std::invoke_result_t<F, Args...>> {
     using return_type = typename std::invoke_result_t<F, Args...>;
 
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
+    // Callable, arguments and result share one pooled node; no std::function,
+    // packaged_task or shared_ptr on the way in.
+    auto bound = [fn = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> return_type {
+        return std::apply(fn, std::move(args));
+    };
+    using Node = detail::TaskNode<decltype(bound), return_type>;
+    Node* node = detail::makeTaskNode<Node>(std::move(bound));
 
-    std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        if(stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-        tasks.emplace([task](){ (*task)(); });
+    try {
+        submit(node);
+    } catch (...) {
+        node->destroy();
+        throw;
     }
-    condition.notify_one();
-    return res;
+    return TaskFuture<return_type>(node);
 }
+    size_t size() const { return workers.size(); }
+    // Run one queued task if the calling thread is a worker of some pool
+    static bool runPendingTask();
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
+    using Task = detail::TaskBase;
+    struct Worker {
+        WorkStealingDeque<Task> deque;
+        std::thread thread;
+    };
+
+    void submit(Task* task);
+    void workerLoop(size_t index);
+    Task* findTask(size_t index, uint32_t& seed);
+    Task* popInjected();
+    void runTask(Task* task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::deque<Task*> injected;
+    std::mutex injectMutex;
+    // Tasks submitted but not yet picked up; workers only sleep when it is 0
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> sleepers{0};
+    std::mutex sleepMutex;
     std::condition_variable condition;
-    bool stop;
+    std::atomic<bool> stop;
 };
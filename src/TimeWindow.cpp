@@ -0,0 +1,51 @@
+#include "TimeWindow.h"
+#include <mutex>
+using namespace std;
+
+namespace {
+constexpr int kMinutesPerDay = 24 * 60;
+}
+
+tm TimeWindow::localTime(time_t t) {
+    // localtime_r is not required to consult TZ itself, so load it once
+    static once_flag zoneLoaded;
+    call_once(zoneLoaded, [] { tzset(); });
+    tm local{};
+    localtime_r(&t, &local);
+    return local;
+}
+
+bool TimeWindow::allDay() const {
+    // Inclusive ends: a window that meets itself covers every minute
+    return (to + 1) % kMinutesPerDay == from;
+}
+
+bool TimeWindow::contains(Clock::time_point t) const {
+    tm local = localTime(Clock::to_time_t(t));
+    int minute = local.tm_hour * 60 + local.tm_min;
+    if (from <= to) return minute >= from && minute <= to;
+    return minute >= from || minute <= to;
+}
+
+TimeWindow::Clock::time_point TimeWindow::nextTransition(Clock::time_point after) const {
+    if (allDay()) return Clock::time_point::max();
+    // Inside: the window closes when the minute after `to` starts.
+    // Outside: it opens at `from`.
+    int boundary = contains(after) ? (to + 1) % kMinutesPerDay : from;
+
+    time_t now = Clock::to_time_t(after);
+    tm local = localTime(now);
+    local.tm_hour = boundary / 60;
+    local.tm_min = boundary % 60;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    time_t candidate = mktime(&local);
+    if (candidate <= now) {
+        local.tm_mday += 1;
+        local.tm_hour = boundary / 60;
+        local.tm_min = boundary % 60;
+        local.tm_isdst = -1;
+        candidate = mktime(&local);
+    }
+    return Clock::from_time_t(candidate);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <chrono>
+#include <ctime>
+
+// A daily window of local wall-clock time with minute precision. Both ends
+// are minutes since midnight and inclusive; from > to wraps past midnight
+// ("22:00 to 06:00").
+struct TimeWindow {
+    using Clock = std::chrono::system_clock;
+
+    int from = 0;
+    int to = 24 * 60 - 1;
+
+    bool contains(Clock::time_point t) const;
+    bool allDay() const;
+    // First instant after `after` at which contains() changes value, or
+    // Clock::time_point::max() for a window that covers the whole day
+    Clock::time_point nextTransition(Clock::time_point after) const;
+
+    // Thread-safe local time; the zone is loaded once per process
+    static std::tm localTime(std::time_t t);
+};
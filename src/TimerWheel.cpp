@@ -0,0 +1,150 @@
+#include "TimerWheel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+using namespace std;
+
+TimerWheel::TimerWheel(ThreadPool& pool) : pool_(pool), start_(Clock::now()) {
+    fill(begin(heads_), end(heads_), kNil);
+    thread_ = thread([this] { run(); });
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        lock_guard<mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+uint64_t TimerWheel::tickOf(Clock::time_point t) const {
+    return static_cast<uint64_t>((t - start_) / kTick);
+}
+
+TimerWheel::Handle TimerWheel::schedule(Clock::duration delay, function<void()> callback) {
+    lock_guard<mutex> lock(mtx_);
+    uint64_t now = tickOf(Clock::now());
+    if (pending_ == 0 && now > current_) {
+        // Nothing armed, so there is nothing to expire on the way
+        current_ = now;
+    }
+    uint64_t ticks = static_cast<uint64_t>((delay + kTick - Clock::duration(1)) / kTick);
+    uint64_t due = max(now + ticks, current_ + 1);
+    due = min<uint64_t>(due, current_ + (uint64_t(1) << (kLevels * kSlotBits)) - 1);
+
+    uint32_t index;
+    if (!free_.empty()) {
+        index = free_.back();
+        free_.pop_back();
+    } else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+    Node& node = nodes_[index];
+    node.callback = std::move(callback);
+    node.due = due;
+    node.armed = true;
+    link(index);
+    if (++pending_ == 1) cv_.notify_one();
+    return Handle{ index, node.generation };
+}
+
+bool TimerWheel::cancel(Handle handle) {
+    lock_guard<mutex> lock(mtx_);
+    if (handle.index >= nodes_.size()) return false;
+    Node& node = nodes_[handle.index];
+    if (!node.armed || node.generation != handle.generation) return false;
+    unlink(handle.index);
+    node.armed = false;
+    node.callback = nullptr;
+    ++node.generation;
+    free_.push_back(handle.index);
+    --pending_;
+    return true;
+}
+
+size_t TimerWheel::pending() const {
+    lock_guard<mutex> lock(mtx_);
+    return pending_;
+}
+
+void TimerWheel::link(uint32_t index) {
+    Node& node = nodes_[index];
+    uint64_t delta = node.due - current_;
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (uint64_t(1) << ((level + 1) * kSlotBits))) ++level;
+    uint32_t slot = level * kSlots + static_cast<uint32_t>((node.due >> (level * kSlotBits)) & (kSlots - 1));
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = kNil;
+    node.next = heads_[slot];
+    if (node.next != kNil) nodes_[node.next].prev = index;
+    heads_[slot] = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Node& node = nodes_[index];
+    if (node.prev != kNil) nodes_[node.prev].next = node.next;
+    else heads_[node.slot] = node.next;
+    if (node.next != kNil) nodes_[node.next].prev = node.prev;
+    node.prev = node.next = kNil;
+}
+
+void TimerWheel::cascade(int level) {
+    uint32_t slot = level * kSlots + static_cast<uint32_t>((current_ >> (level * kSlotBits)) & (kSlots - 1));
+    uint32_t index = heads_[slot];
+    heads_[slot] = kNil;
+    while (index != kNil) {
+        uint32_t next = nodes_[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t target, vector<function<void()>>& expired) {
+    while (current_ < target && pending_ > 0) {
+        ++current_;
+        // Entering a new block of a level pulls that block's timers down,
+        // coarsest level first
+        int top = 0;
+        while (top + 1 < kLevels && (current_ & ((uint64_t(1) << ((top + 1) * kSlotBits)) - 1)) == 0) ++top;
+        for (int level = top; level >= 1; --level) cascade(level);
+
+        uint32_t slot = static_cast<uint32_t>(current_ & (kSlots - 1));
+        uint32_t index = heads_[slot];
+        heads_[slot] = kNil;
+        while (index != kNil) {
+            Node& node = nodes_[index];
+            uint32_t next = node.next;
+            expired.push_back(std::move(node.callback));
+            node.callback = nullptr;
+            node.armed = false;
+            ++node.generation;
+            free_.push_back(index);
+            --pending_;
+            index = next;
+        }
+    }
+    if (pending_ == 0 && current_ < target) current_ = target;
+}
+
+void TimerWheel::run() {
+    unique_lock<mutex> lock(mtx_);
+    vector<function<void()>> expired;
+    while (!stop_) {
+        if (pending_ == 0) {
+            cv_.wait(lock, [this] { return stop_ || pending_ > 0; });
+            continue;
+        }
+        cv_.wait_until(lock, start_ + kTick * static_cast<int64_t>(current_ + 1), [this] { return stop_; });
+        if (stop_) break;
+        advance(tickOf(Clock::now()), expired);
+        if (expired.empty()) continue;
+
+        lock.unlock();
+        for (auto& callback : expired) {
+            pool_.enqueue(std::move(callback));
+        }
+        expired.clear();
+        lock.lock();
+    }
+}
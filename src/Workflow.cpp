@@ -1,49 +1,173 @@
 #include "Workflow.h"
 #include "PluginLoader.h"
+#include "ActionBatcher.h"
 #include "RuleEngine.h"
+#include "TimerWheel.h"
+#include "StateJournal.h"
 #include <iostream>
+#include <chrono>
+#include <climits>
+#include <stdexcept>
 using namespace std;
-Workflow::Workflow(const string& name, const vector<ActionConfig>& actions, const nlohmann::json& rule)
-    : name_(name), actions_(actions), rule_(rule) {}
-void Workflow::execute() {
-    cout << "Starting workflow: " + name_ << endl;
-    if (!RuleEngine::evaluate(rule_)) {
-        cout << "Rule not satisfied for workflow: " + name_ << endl;
-        return;
+
+namespace {
+// Runs kept per workflow in the state file
+constexpr size_t kHistoryKeep = 100;
+
+string describe(const exception_ptr& error) {
+    try {
+        rethrow_exception(error);
+    } catch (const exception& e) {
+        return e.what();
+    } catch (...) {
+        return "unknown error";
     }
-    PluginLoader loader;
-    for (const auto& action : actions_) {
-        cout << "  Executing action: " + action.type + " with params: " + action.params << endl;
-        try {
-            auto plugin = loader.load("plugins/" + action.type + ".so");
-            plugin->execute(action.params);
-            cout << "  Action " + action.type + " completed." << endl;
-        } catch (const exception& e) {
-            cout << "  Action " + action.type + " failed: " + e.what() << endl;
-        }
+}
+}
+
+int Workflow::delayMinutes(const nlohmann::json& params) {
+    if (!params.is_object()) return 0;
+    auto it = params.find("delay");
+    if (it == params.end()) return 0;
+    if (!it->is_number_integer() || it->get<long long>() < 0 || it->get<long long>() > INT_MAX) {
+        throw invalid_argument("\"delay\" must be a whole number of minutes, got " + it->dump());
     }
-    cout << "Workflow completed: " + name_ << endl;
+    return it->get<int>();
+}
+
+Workflow::Workflow(const string& name, const vector<ActionConfig>& actions, CompiledRule rule)
+    : name_(name), actions_(actions), rule_(std::move(rule)) {}
+void Workflow::executeAsync(TimerWheel& timers, function<void()> done) {
+    auto run = make_shared<Run>();
+    run->timers = &timers;
+    run->done = std::move(done);
+    begin(run);
 }
 
-void Workflow::executeWithOverrides(const std::vector<std::string>& overrides) {
-    cout << "Starting workflow (with overrides): " + name_ << endl;
-    if (!RuleEngine::evaluate(rule_)) {
+void Workflow::executeWithOverridesAsync(TimerWheel& timers, const vector<string>& overrides,
+                                         function<void()> done) {
+    auto run = make_shared<Run>();
+    run->overrides = overrides;
+    run->withOverrides = true;
+    run->timers = &timers;
+    run->done = std::move(done);
+    begin(run);
+}
+
+void Workflow::begin(const shared_ptr<Run>& run) {
+    cout << (run->withOverrides ? "Starting workflow (with overrides): " : "Starting workflow: ") + name_ << endl;
+    if (!rule_.evaluate()) {
         cout << "Rule not satisfied for workflow: " + name_ << endl;
+        record(*run, "skipped");
+        if (run->done) run->done();
         return;
     }
-    PluginLoader loader;
-    for (size_t i = 0; i < actions_.size(); ++i) {
+    runActions(run);
+}
+
+void Workflow::finish(const shared_ptr<Run>& run) {
+    cout << "Workflow completed: " + name_ << endl;
+    record(*run, run->failures ? "failed" : "ok");
+    if (run->done) run->done();
+}
+
+void Workflow::record(const Run& run, const char* status) {
+    if (!journal_) return;
+    auto elapsed = chrono::steady_clock::now() - run.startedSteady;
+    nlohmann::json entry = {
+        {"started", chrono::duration_cast<chrono::milliseconds>(run.started.time_since_epoch()).count()},
+        {"ms", chrono::duration_cast<chrono::milliseconds>(elapsed).count()},
+        {"status", status}
+    };
+    if (run.failures) entry["failedActions"] = run.failures;
+    if (run.withOverrides) entry["overrides"] = run.overrides;
+    string base = "/workflows/" + StateJournal::escape(name_);
+    try {
+        journal_->apply({ StateJournal::push(base + "/history", std::move(entry), kHistoryKeep),
+                          StateJournal::add(base + "/counts/" + status, 1) });
+    } catch (...) {
+        // Losing a history entry must not keep the run from completing
+        cerr << "Cannot record run of workflow " << name_ << ": " << describe(current_exception()) << endl;
+    }
+}
+
+void Workflow::runActions(const shared_ptr<Run>& run) {
+    const vector<string>& overrides = run->overrides;
+    size_t i = run->next;
+    while (i < actions_.size()) {
         const auto& action = actions_[i];
-        string params = (i < overrides.size() && !overrides[i].empty()) ? overrides[i] : action.params;
-        cout << "  Executing action: " + action.type + " with params: " + params << endl;
+        string pluginPath = "plugins/" + action.type + ".so";
+        size_t end = i + 1;
         try {
-            auto plugin = loader.load("plugins/" + action.type + ".so");
-            plugin->execute(params);
-            cout << "  Action " + action.type + " completed." << endl;
-        } catch (const exception& e) {
-            cout << "  Action " + action.type + " failed: " + e.what() << endl;
+            if (!PluginLoader::instance().info(pluginPath).v2) {
+                bool overridden = i < overrides.size() && !overrides[i].empty();
+                const string& params = overridden ? overrides[i] : action.params;
+                cout << "  Executing action: " + action.type + " with params: " + params << endl;
+                auto plugin = PluginLoader::instance().acquire(pluginPath);
+                plugin->execute(params);
+                cout << "  Action " + action.type + " completed." << endl;
+                i = end;
+                continue;
+            }
+
+            // Consecutive actions of the same v2 plugin (fan-out) are
+            // submitted together so they end up in one executeBatch call.
+            // A delayed action always starts a group of its own.
+            vector<nlohmann::json> params;
+            params.reserve(actions_.size() - i);
+            for (size_t k = i; k < actions_.size() && actions_[k].type == action.type; ++k) {
+                bool overridden = k < overrides.size() && !overrides[k].empty();
+                nlohmann::json p = overridden ? IActionV2::parseParams(overrides[k]) : actions_[k].paramsJson;
+                int delay;
+                try {
+                    delay = delayMinutes(p);
+                } catch (...) {
+                    // Only the action with the bad delay fails
+                    if (k > i) break;
+                    throw;
+                }
+                if (delay > 0) {
+                    if (k > i) break;
+                    if (!run->delayElapsed) {
+                        cout << "  Delaying action: " + action.type + " by " + to_string(delay) + " minutes" << endl;
+                        run->next = i;
+                        run->delayElapsed = true;
+                        // Park the remainder of the run; no thread waits for it
+                        run->timers->schedule(chrono::minutes(delay), [this, run]() { runActions(run); });
+                        return;
+                    }
+                    run->delayElapsed = false;
+                    // The engine owns the wait; the plugin must not sleep again
+                    p.erase("delay");
+                }
+                cout << "  Executing action: " + action.type + " with params: " +
+                        (overridden ? overrides[k] : actions_[k].params) << endl;
+                params.push_back(std::move(p));
+                end = k + 1;
+            }
+            vector<const nlohmann::json*> batch;
+            batch.reserve(params.size());
+            for (const auto& p : params) batch.push_back(&p);
+            auto results = ActionBatcher::instance().execute(pluginPath, batch);
+            for (size_t k = i; k < end; ++k) {
+                if (!results[k - i]) {
+                    cout << "  Action " + action.type + " completed." << endl;
+                    continue;
+                }
+                ++run->failures;
+                cout << "  Action " + action.type + " failed: " + describe(results[k - i]) << endl;
+            }
+        } catch (...) {
+            // Whatever escapes, the run still has to finish so `done` fires;
+            // a resumed run has nobody else to report to
+            string what = describe(current_exception());
+            run->failures += end - i;
+            for (size_t k = i; k < end; ++k) {
+                cout << "  Action " + action.type + " failed: " + what << endl;
+            }
         }
+        i = end;
     }
-    cout << "Workflow completed: " + name_ << endl;
+    finish(run);
 }
 string Workflow::getName() const { return name_; }
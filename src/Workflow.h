@@ -2,20 +2,53 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
+#include <chrono>
 #include "utils/json.hpp"
+#include "RuleEngine.h"
+class TimerWheel;
+class StateJournal;
 struct ActionConfig {
     std::string type;
     std::string params;
+    nlohmann::json paramsJson; // pre-parsed form handed to v2 plugins
 };
 class Workflow {
 public:
-    Workflow(const std::string& name, const std::vector<ActionConfig>& actions, const nlohmann::json& rule = {});
-    void execute();
-    void executeWithOverrides(const std::vector<std::string>& overrides);
+    Workflow(const std::string& name, const std::vector<ActionConfig>& actions, CompiledRule rule = {});
+    // Runs never block on a delay: an action with a "delay" parks the rest
+    // of the run on the timer wheel and the calling thread returns. `done`
+    // is invoked once the run has finished or the rule rejected it.
+    void executeAsync(TimerWheel& timers, std::function<void()> done);
+    void executeWithOverridesAsync(TimerWheel& timers, const std::vector<std::string>& overrides,
+                                   std::function<void()> done);
+    // Minutes an action's params ask to wait before it runs. Throws
+    // std::invalid_argument unless "delay" is a non-negative integer.
+    static int delayMinutes(const nlohmann::json& params);
     std::string getName() const;
     const std::vector<ActionConfig>& getActions() const { return actions_; }
+    const CompiledRule& getRule() const { return rule_; }
+    // Each finished or skipped run is appended to the workflow's history there
+    void setJournal(StateJournal* journal) { journal_ = journal; }
 private:
+    struct Run {
+        std::vector<std::string> overrides;
+        bool withOverrides = false;
+        TimerWheel* timers = nullptr; // where delayed actions are parked
+        std::function<void()> done;
+        size_t next = 0;           // first action that has not run yet
+        bool delayElapsed = false; // action `next` already waited out its delay
+        std::chrono::system_clock::time_point started = std::chrono::system_clock::now();
+        std::chrono::steady_clock::time_point startedSteady = std::chrono::steady_clock::now();
+        size_t failures = 0;
+    };
+
+    void begin(const std::shared_ptr<Run>& run);
+    void runActions(const std::shared_ptr<Run>& run);
+    void finish(const std::shared_ptr<Run>& run);
+    void record(const Run& run, const char* status);
     std::string name_;
     std::vector<ActionConfig> actions_;
-    nlohmann::json rule_;
+    CompiledRule rule_;
+    StateJournal* journal_ = nullptr;
 };
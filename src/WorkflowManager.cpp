@@ -1,87 +1,197 @@
 #include "WorkflowManager.h"
+#include "ConfigCache.h"
 #include "utils/JSONParser.h"
+#include "IAction.h"
 #include "ThreadPool.h"
+#include "PluginLoader.h"
+#include "Logger.h"
 #include <iostream>
+#include <set>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
 #include <future>
 
 using namespace std;
 
+WorkflowManager::~WorkflowManager() {
+    // Background runs report back to this object; let them drain first
+    stopBackground();
+}
+
 void WorkflowManager::loadWorkflows(const string& configPath) {
-    auto j = JSONParser::parseFile(configPath);
+    // Workflows are built as the parser reaches them, so a config with
+    // thousands of them never exists as one big DOM
+    size_t loaded = workflows_.size(), background = background_.size();
+    nlohmann::json j;
+    try {
+        j = JSONParser::streamFile(configPath, "workflows", [this](nlohmann::json&& wf) { addWorkflow(wf); });
+    } catch (const JSONParser::ParseError& e) {
+        // Nothing from a config that is only half there
+        background_.resize(background);
+        workflows_.resize(loaded);
+        cerr << "WorkflowManager::loadWorkflows: " << e.what() << " (byte " << e.offset() << ")\n";
+        return;
+    }
 
     // Guard: file could be empty or not contain "workflows"
-    if (!j.is_object() || !j.contains("workflows") || !j["workflows"].is_array()) {
+    if (!j.contains("workflows") || !j["workflows"].is_array()) {
         cerr << "WorkflowManager::loadWorkflows: no 'workflows' array found in " << configPath << "\n";
         return;
     }
 
-    for (const auto& wf : j["workflows"]) {
-        // Basic validation
-        if (!wf.is_object() || !wf.contains("name") || !wf.contains("actions")) {
-            cerr << "Skipping invalid workflow entry in config (missing name/actions)\n";
+    readSettings(j);
+}
+
+bool WorkflowManager::loadWorkflow(const string& configPath, const string& name) {
+    ConfigCache cache(configPath);
+    if (!cache.valid()) {
+        // Let the full load report what is wrong with the config
+        loadWorkflows(configPath);
+        return false;
+    }
+    readSettings(cache.globals());
+    auto wf = cache.find(name);
+    if (!wf) return false;
+    static const LogSite site("Loaded workflow '{}' of {} from the config cache{}", __FILE__, __LINE__);
+    Logger::instance().record(site, name, cache.size(), cache.hit() ? "" : " (rebuilt)");
+    return addWorkflow(*wf);
+}
+
+void WorkflowManager::readSettings(const nlohmann::json& config) {
+    if (config.contains("threads") && config["threads"].is_number_unsigned()) {
+        configuredThreads_ = config["threads"].get<size_t>();
+    }
+}
+
+bool WorkflowManager::addWorkflow(const nlohmann::json& wf) {
+    // Basic validation
+    if (!wf.is_object() || !wf.contains("name") || !wf.contains("actions")) {
+        cerr << "Skipping invalid workflow entry in config (missing name/actions)\n";
+        return false;
+    }
+
+    string name;
+    try {
+        name = wf["name"].get<std::string>();
+    } catch (...) {
+        cerr << "Skipping workflow with invalid name type\n";
+        return false;
+    }
+
+    vector<ActionConfig> actions;
+    if (!wf["actions"].is_array()) {
+        cerr << "Workflow '" << name << "' has invalid 'actions' (not an array). Skipping.\n";
+        return false;
+    }
+
+    for (const auto& act : wf["actions"]) {
+        if (!act.is_object() || !act.contains("type")) {
+            cerr << "Skipping invalid action in workflow '" << name << "' (missing type)\n";
             continue;
         }
 
-        string name;
+        string type;
         try {
-            name = wf["name"].get<std::string>();
+            type = act["type"].get<std::string>();
         } catch (...) {
-            cerr << "Skipping workflow with invalid name type\n";
-            continue;
-        }
-
-        vector<ActionConfig> actions;
-        if (!wf["actions"].is_array()) {
-            cerr << "Workflow '" << name << "' has invalid 'actions' (not an array). Skipping.\n";
+            cerr << "Skipping action with invalid type in workflow '" << name << "'\n";
             continue;
         }
 
-        for (const auto& act : wf["actions"]) {
-            if (!act.is_object() || !act.contains("type")) {
-                cerr << "Skipping invalid action in workflow '" << name << "' (missing type)\n";
-                continue;
-            }
-
-            string type;
+        // v1 plugins get params as a string, v2 plugins get the parsed JSON.
+        // If params missing => empty string / null.
+        std::string paramsStr;
+        nlohmann::json paramsJson;
+        if (act.contains("params")) {
             try {
-                type = act["type"].get<std::string>();
-            } catch (...) {
-                cerr << "Skipping action with invalid type in workflow '" << name << "'\n";
-                continue;
-            }
-
-            // Ensure params is passed to plugins as a string. If params missing => empty string.
-            std::string paramsStr;
-            if (act.contains("params")) {
-                try {
-                    if (act["params"].is_string()) {
-                        paramsStr = act["params"].get<std::string>();
-                    } else {
-                        paramsStr = act["params"].dump();
-                    }
-                } catch (...) {
-                    paramsStr = "";
+                if (act["params"].is_string()) {
+                    paramsStr = act["params"].get<std::string>();
+                    paramsJson = IActionV2::parseParams(paramsStr);
+                } else {
+                    paramsStr = act["params"].dump();
+                    paramsJson = act["params"];
                 }
-            } else {
+            } catch (...) {
                 paramsStr = "";
             }
+        } else {
+            paramsStr = "";
+        }
 
-            actions.push_back({ type, paramsStr });
+        try {
+            Workflow::delayMinutes(paramsJson);
+        } catch (const std::exception& e) {
+            cerr << "Workflow '" << name << "' has an invalid " << type << " action (" << e.what() << "). Skipping.\n";
+            return false;
         }
+        actions.push_back({ type, paramsStr, std::move(paramsJson) });
+    }
+
+    // Rules are compiled once here; runs only walk the compiled form
+    CompiledRule rule;
+    if (wf.contains("rule")) {
+        try {
+            rule = RuleEngine::compile(wf["rule"]);
+        } catch (const std::exception& e) {
+            cerr << "Workflow '" << name << "' has an invalid rule (" << e.what() << "). Skipping.\n";
+            return false;
+        }
+    }
+    if (!journal_) journal_ = std::make_unique<StateJournal>("data/state.json");
+    workflows_.push_back(std::make_unique<Workflow>(name, actions, std::move(rule)));
+    workflows_.back()->setJournal(journal_.get());
 
-        nlohmann::json rule = wf.contains("rule") ? wf["rule"] : nlohmann::json{};
-        workflows_.push_back(std::make_unique<Workflow>(name, actions, rule));
+    if (!parseBackground(wf, workflows_.back().get())) {
+        workflows_.pop_back();
+        return false;
     }
+    return true;
+
+}
+
+bool WorkflowManager::preloadPlugins() {
+    set<string> types;
+    for (const auto& wf : workflows_) {
+        if (!wf) continue;
+        for (const auto& act : wf->getActions()) types.insert(act.type);
+    }
+    if (types.empty()) return true;
+
+    // dlopen, relocation and the plugin constructors are independent per
+    // type, so warm them up side by side.
+    ThreadPool& pool = executor();
+    vector<pair<string, TaskFuture<void>>> pending;
+    pending.reserve(types.size());
+    for (const auto& type : types) {
+        pending.emplace_back(type, pool.enqueue([type]() {
+            // The lease puts the instance straight into the pool for reusable plugins
+            PluginLoader::instance().acquire("plugins/" + type + ".so");
+        }));
+    }
+
+    bool ok = true;
+    for (auto& p : pending) {
+        try {
+            p.second.get();
+        } catch (const std::exception& e) {
+            cerr << "Plugin '" << p.first << "' failed to load: " << e.what() << "\n";
+            ok = false;
+        }
+    }
+    return ok;
 }
 
 void WorkflowManager::startAll() {
     // If no workflows, nothing to do
     if (workflows_.empty()) return;
 
-    // Create a thread pool (size can be configured; 4 is default here)
-    ThreadPool pool(4);
-    vector<future<void>> futures;
+    ThreadPool& pool = executor();
+    TimerWheel& wheel = timers();
+    vector<TaskFuture<void>> futures;
+    vector<future<void>> done;
     futures.reserve(workflows_.size());
+    done.reserve(workflows_.size());
 
     // Important: capture a stable pointer to each workflow for use inside the lambda.
     // Capturing the loop variable by reference would be UB because the reference
@@ -89,15 +199,19 @@ void WorkflowManager::startAll() {
     for (const auto& wfPtr : workflows_) {
         Workflow* raw = wfPtr.get();
         if (!raw) continue;
-        futures.push_back(pool.enqueue([raw]() {
-            raw->execute();
+        auto finished = make_shared<promise<void>>();
+        futures.push_back(pool.enqueue([raw, &wheel, finished]() {
+            raw->executeAsync(wheel, [finished]() { finished->set_value(); });
         }));
+        done.push_back(finished->get_future());
     }
 
-    // Wait for all workflows to finish
-    for (auto& f : futures) {
+    // Wait for all workflows to finish; a run that parked a delayed action
+    // returns from its task early and completes later from a timer
+    for (size_t i = 0; i < futures.size(); ++i) {
         try {
-            f.get();
+            futures[i].get();
+            done[i].wait();
         } catch (const std::exception& e) {
             cerr << "Exception from workflow thread: " << e.what() << "\n";
         } catch (...) {
@@ -106,10 +220,48 @@ void WorkflowManager::startAll() {
     }
 }
 
+ThreadPool& WorkflowManager::executor() {
+    if (!pool_) {
+        size_t threads = configuredThreads_;
+        if (const char* env = getenv("FLOWFORGE_THREADS")) {
+            try {
+                threads = stoul(env);
+            } catch (...) {
+                cerr << "Ignoring invalid FLOWFORGE_THREADS value '" << env << "'\n";
+            }
+        }
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+        pool_ = make_unique<ThreadPool>(threads);
+    }
+    return *pool_;
+}
+
+TimerWheel& WorkflowManager::timers() {
+    if (!timers_) timers_ = make_unique<TimerWheel>(executor());
+    return *timers_;
+}
+
+void WorkflowManager::runOnExecutor(const function<void(function<void()>)>& start) {
+    // Interactive runs go through the same warm threads as startAll; the
+    // caller just blocks until its run is done.
+    auto finished = make_shared<promise<void>>();
+    future<void> done = finished->get_future();
+    try {
+        executor().enqueue(start, [finished]() { finished->set_value(); }).get();
+        done.wait();
+    } catch (const std::exception& e) {
+        cerr << "Exception from workflow thread: " << e.what() << "\n";
+    } catch (...) {
+        cerr << "Unknown exception from workflow thread\n";
+    }
+}
+
 void WorkflowManager::startWorkflow(const string& name) {
     for (const auto& wf : workflows_) {
         if (wf && wf->getName() == name) {
-            wf->execute();
+            Workflow* raw = wf.get();
+            TimerWheel& wheel = timers();
+            runOnExecutor([raw, &wheel](function<void()> done) { raw->executeAsync(wheel, std::move(done)); });
             return;
         }
     }
@@ -119,13 +271,141 @@ void WorkflowManager::startWorkflow(const string& name) {
 void WorkflowManager::startWorkflowWithOverrides(const string& name, const std::vector<string>& overrides) {
     for (const auto& wf : workflows_) {
         if (wf && wf->getName() == name) {
-            wf->executeWithOverrides(overrides);
+            Workflow* raw = wf.get();
+            TimerWheel& wheel = timers();
+            runOnExecutor([raw, &wheel, &overrides](function<void()> done) {
+                raw->executeWithOverridesAsync(wheel, overrides, std::move(done));
+            });
             return;
         }
     }
     cout << "Workflow not found: " << name << endl;
 }
 
+bool WorkflowManager::parseBackground(const nlohmann::json& wf, Workflow* workflow) {
+    auto entry = make_unique<BackgroundWorkflow>(workflow);
+    string name = workflow->getName();
+
+    if (wf.contains("schedule")) {
+        try {
+            entry->schedule = Schedule::parse(wf["schedule"].get<std::string>());
+        } catch (const std::exception& e) {
+            cerr << "Workflow '" << name << "' has an invalid schedule (" << e.what() << "). Skipping.\n";
+            return false;
+        }
+    }
+
+    // "on": {"file": "/path"[, "debounce_ms": 200]} or an array of those
+    if (wf.contains("on")) {
+        nlohmann::json on = wf["on"].is_array() ? wf["on"] : nlohmann::json::array({ wf["on"] });
+        for (const auto& t : on) {
+            if (!t.is_object() || !t.contains("file") || !t["file"].is_string()) {
+                cerr << "Workflow '" << name << "' has an invalid 'on' trigger (expected {\"file\": path}). Ignoring it.\n";
+                continue;
+            }
+            string path = t["file"].get<std::string>();
+            // Accept the rule spelling too
+            if (path.rfind("exists ", 0) == 0) path = path.substr(7);
+            long debounce = t.contains("debounce_ms") && t["debounce_ms"].is_number_integer()
+                ? t["debounce_ms"].get<long>() : 200;
+            // Only a file that is actually there fires the run
+            CompiledRule guard = RuleEngine::compile({ { "if", { { "file", "exists " + path } } } });
+            entry->triggers.push_back({ path, chrono::milliseconds(max(0L, debounce)), std::move(guard) });
+        }
+    }
+
+    if (entry->schedule || !entry->triggers.empty()) background_.push_back(std::move(entry));
+    return true;
+}
+
+bool WorkflowManager::startBackground() {
+    if (background_.empty()) return false;
+    // Warm both up front so the first tick does not pay for thread creation
+    executor();
+    timers();
+    scheduler_ = make_unique<Scheduler>();
+    for (auto& entry : background_) {
+        BackgroundWorkflow* raw = entry.get();
+        if (!raw->schedule) continue;
+        Scheduler::Gate gate;
+        const CompiledRule& rule = raw->workflow->getRule();
+        if (rule.timeOnly()) {
+            // Skip ticks that fall outside the rule's time windows instead
+            // of waking up just to find the rule false
+            gate = [&rule](Scheduler::Clock::time_point t) {
+                for (int step = 0; step < 64; ++step) {
+                    if (rule.holdsAt(t)) return t;
+                    t = rule.nextTransition(t);
+                    if (t == Scheduler::Clock::time_point::max()) break;
+                }
+                return Scheduler::Clock::time_point::max();
+            };
+        }
+        scheduler_->add(*raw->schedule, [this, raw]() { launch(*raw, "scheduled"); }, std::move(gate));
+        FLOWFORGE_LOG("Scheduled workflow '{}': {}", raw->workflow->getName(), raw->schedule->spec());
+    }
+
+    for (auto& entry : background_) {
+        BackgroundWorkflow* raw = entry.get();
+        for (auto& trigger : raw->triggers) {
+            try {
+                if (!watcher_) watcher_ = make_unique<FileWatcher>();
+                const CompiledRule* guard = &trigger.guard;
+                watcher_->watch(trigger.path, trigger.debounce, [this, raw, guard]() {
+                    if (guard->evaluate()) launch(*raw, "triggered");
+                });
+                FLOWFORGE_LOG("Workflow '{}' triggers on {}", raw->workflow->getName(), trigger.path);
+            } catch (const std::exception& e) {
+                cerr << "Workflow '" << raw->workflow->getName() << "': cannot watch " << trigger.path
+                     << " (" << e.what() << ")\n";
+            }
+        }
+    }
+
+    if (scheduler_->size() == 0 && (!watcher_ || watcher_->size() == 0)) return false;
+    scheduler_->start();
+    if (watcher_) watcher_->start();
+    return true;
+}
+
+void WorkflowManager::launch(BackgroundWorkflow& entry, const string& cause) {
+    if (entry.running.exchange(true)) {
+        FLOWFORGE_LOG("Skipping {} run of '{}': previous run still in progress", cause, entry.workflow->getName());
+        return;
+    }
+    {
+        lock_guard<mutex> lock(runsMtx_);
+        ++activeRuns_;
+    }
+    auto done = [this, &entry]() {
+        entry.running.store(false);
+        lock_guard<mutex> lock(runsMtx_);
+        if (--activeRuns_ == 0) runsCv_.notify_all();
+    };
+    // Fire and forget: completion is tracked through `done`
+    Workflow* raw = entry.workflow;
+    TimerWheel& wheel = timers();
+    executor().enqueue([raw, &wheel, done]() {
+        try {
+            raw->executeAsync(wheel, done);
+        } catch (const std::exception& e) {
+            cerr << "Exception from workflow thread: " << e.what() << "\n";
+            done();
+        }
+    });
+}
+
+void WorkflowManager::stopBackground() {
+    if (!scheduler_) return;
+    scheduler_->stop();
+    if (watcher_) watcher_->stop();
+    unique_lock<mutex> lock(runsMtx_);
+    if (activeRuns_ > 0) {
+        FLOWFORGE_LOG("Waiting for {} running workflow(s) to finish", activeRuns_);
+    }
+    runsCv_.wait(lock, [this] { return activeRuns_ == 0; });
+}
+
 std::vector<std::string> WorkflowManager::listWorkflowNames() const {
     std::vector<std::string> names;
     names.reserve(workflows_.size());
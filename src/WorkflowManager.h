@@ -1,17 +1,84 @@
 #pragma once
 #include "Workflow.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+#include "Scheduler.h"
+#include "FileWatcher.h"
+#include "StateJournal.h"
 #include <vector>
 #include <memory>
 #include <string>
+#include <functional>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 class WorkflowManager {
 public:
+    ~WorkflowManager();
     void loadWorkflows(const std::string& configPath);
+    // Loads just the named workflow through the compiled config cache
+    // (see ConfigCache). Returns false if there is no valid workflow by that
+    // name.
+    bool loadWorkflow(const std::string& configPath, const std::string& name);
+    // Resolve and instantiate every plugin referenced by the loaded workflows.
+    // Returns false (after reporting each failure) if any plugin is unusable.
+    bool preloadPlugins();
     void startAll();
     void startWorkflow(const std::string& name);
     void startWorkflowWithOverrides(const std::string& name, const std::vector<std::string>& overrides);
+    // Daemon mode: fire every workflow that has a "schedule" or an "on" file
+    // trigger. Returns false if there is none. stopBackground() waits for
+    // runs still in flight.
+    bool startBackground();
+    void stopBackground();
     std::vector<std::string> listWorkflowNames() const;
     // Return action descriptions (type + params) for a workflow by name
     std::vector<std::string> getActionSummaries(const std::string& name) const;
+    // Engine-wide executor shared by batch, interactive and preload work.
+    // Sized by FLOWFORGE_THREADS, then the config's "threads" key, then
+    // hardware_concurrency; created on first use.
+    ThreadPool& executor();
+    // Timer wheel for delayed actions; callbacks run on executor()
+    TimerWheel& timers();
 private:
+    // Starts an asynchronous run on the executor and blocks until it has
+    // finished, including any actions parked on the timer wheel
+    void runOnExecutor(const std::function<void(std::function<void()>)>& start);
+
+    struct FileTrigger {
+        std::string path;
+        std::chrono::milliseconds debounce;
+        CompiledRule guard; // the "file" condition, re-checked after the debounce
+    };
+    // A workflow that runs on its own in daemon mode
+    struct BackgroundWorkflow {
+        explicit BackgroundWorkflow(Workflow* w) : workflow(w) {}
+        Workflow* workflow;
+        std::optional<Schedule> schedule;
+        std::vector<FileTrigger> triggers;
+        // A run still going when the next tick or event comes is not overlapped
+        std::atomic<bool> running{false};
+    };
+    void readSettings(const nlohmann::json& config);
+    // Returns false (after reporting why) if the definition is skipped
+    bool addWorkflow(const nlohmann::json& wf);
+    // Returns false (after reporting why) if the schedule is unusable
+    bool parseBackground(const nlohmann::json& wf, Workflow* workflow);
+    void launch(BackgroundWorkflow& entry, const std::string& cause);
+
     std::vector<std::unique_ptr<Workflow>> workflows_;
+    std::vector<std::unique_ptr<BackgroundWorkflow>> background_;
+    std::mutex runsMtx_;
+    std::condition_variable runsCv_;
+    size_t activeRuns_ = 0;
+    size_t configuredThreads_ = 0;
+    // Run history (data/state.json); outlives the runs that record into it
+    std::unique_ptr<StateJournal> journal_;
+    // Declared last so queued workflow runs finish before workflows_ goes away
+    std::unique_ptr<ThreadPool> pool_;
+    // Stopped before the pool so no expiry is enqueued on a dead executor
+    std::unique_ptr<TimerWheel> timers_;
+    std::unique_ptr<Scheduler> scheduler_;
+    std::unique_ptr<FileWatcher> watcher_;
 };
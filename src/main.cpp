@@ -1,6 +1,8 @@
 #include "WorkflowManager.h"
 #include "Logger.h"
 #include "PathUtils.h"
+#include "PluginLoader.h"
+#include "RuleEngine.h"
 #include <iostream>
 #include <string>
 #include <limits>
@@ -12,6 +14,8 @@
 #include <vector>
 #include <cctype>
 #include <curl/curl.h> // Add curl header for global init
+#include <csignal>
+#include <pthread.h>
 
 using namespace std;
 
@@ -43,6 +47,32 @@ static vector<int> parseSelectionList(const string &s, size_t max) {
     return result;
 }
 
+// Record how often plugin resolution was served from the cache
+static void logPluginStats() {
+    auto stats = PluginLoader::instance().stats();
+    FLOWFORGE_LOG("Plugin cache: {} hits, {} misses, {} pooled instances reused",
+                  stats.hits, stats.misses, stats.reused);
+    for (const auto& m : PluginLoader::instance().host().metrics()) {
+        FLOWFORGE_LOG("Plugin metric {}.{}: {} samples, sum {}, min {}, max {}",
+                      m.plugin, m.name, m.count, m.sum, m.min, m.max);
+    }
+}
+
+// Record how much work rule short-circuiting and reordering saved
+static void logRuleStats() {
+    auto stats = RuleEngine::stats();
+    if (stats.leafEvaluations == 0) return;
+    FLOWFORGE_LOG("Rules: {} leaf evaluations, {} skipped by short-circuit, {} reorders",
+                  stats.leafEvaluations, stats.leavesSkipped, stats.reorders);
+}
+
+// Lines lost to a full async log queue (FLOWFORGE_LOG_OVERFLOW=drop|count)
+static void logDroppedLines() {
+    uint64_t dropped = Logger::instance().dropped();
+    if (dropped == 0) return;
+    FLOWFORGE_LOG("Logger: {} lines dropped because the log buffer was full", dropped);
+}
+
 // Helper function to ensure data directories exist
 static void ensureDirectoriesExist() {
     namespace fs = std::filesystem;
@@ -55,6 +85,61 @@ static void ensureDirectoriesExist() {
     }
 }
 
+// Locate config/workflows.json from several likely locations so running from build/ works
+static string findConfig() {
+    namespace fs = std::filesystem;
+    std::vector<std::string> candidates = {
+        "config/workflows.json",
+        "../config/workflows.json",
+        "./config/workflows.json",
+        "../../config/workflows.json"
+    };
+    for (const auto &c : candidates) {
+        if (fs::exists(c)) return c;
+    }
+    cout << "No workflow config found (tried config/workflows.json and parent dirs).\n";
+    cout << "Please run from repository root or place config/workflows.json accordingly.\n";
+    return "";
+}
+
+// Long-running mode: load once, then fire scheduled and triggered workflows until
+// SIGINT/SIGTERM
+static int runDaemon() {
+    // Block the stop signals before any thread exists so every thread
+    // inherits the mask and only sigwait below sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    string usedConfig = findConfig();
+    if (usedConfig.empty()) return 1;
+    cout << "Using workflow config: " << usedConfig << "\n";
+
+    WorkflowManager manager;
+    manager.loadWorkflows(usedConfig);
+    if (!manager.preloadPlugins()) {
+        cout << "Aborting: not all plugins referenced by the config could be loaded.\n";
+        return 1;
+    }
+    if (!manager.startBackground()) {
+        cout << "No workflow has a \"schedule\" or \"on\" trigger; nothing to run in daemon mode.\n";
+        return 1;
+    }
+    FLOWFORGE_LOG("Daemon started");
+
+    int sig = 0;
+    sigwait(&signals, &sig);
+    FLOWFORGE_LOG("Daemon stopping on {}", sig == SIGINT ? "SIGINT" : "SIGTERM");
+    manager.stopBackground();
+    logPluginStats();
+    logRuleStats();
+    logDroppedLines();
+    FLOWFORGE_LOG("Engine exited.");
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     // Initialize libcurl globally (prevent segfaults in MessageAction)
     curl_global_init(CURL_GLOBAL_DEFAULT);
@@ -66,64 +151,55 @@ int main(int argc, char* argv[]) {
     if (argc >= 3 && (string(argv[1]) == "run" || string(argv[1]) == "r")) {
         string workflowName = argv[2];
         WorkflowManager manager;
-        // Locate config/workflows.json from several likely locations so running from build/ works
-        namespace fs = std::filesystem;
-        std::vector<std::string> candidates = {
-            "config/workflows.json",
-            "../config/workflows.json",
-            "./config/workflows.json",
-            "../../config/workflows.json"
-        };
-        std::string usedConfig;
-        for (const auto &c : candidates) {
-            if (fs::exists(c)) { usedConfig = c; break; }
-        }
+        std::string usedConfig = findConfig();
         if (usedConfig.empty()) {
-            cout << "No workflow config found (tried config/workflows.json and parent dirs).\n";
-            cout << "Please run from repository root or place config/workflows.json accordingly.\n";
             curl_global_cleanup();
             return 1;
         }
         cout << "Using workflow config: " << usedConfig << "\n";
-        manager.loadWorkflows(usedConfig);
-
-        auto names = manager.listWorkflowNames();
-        if (find(names.begin(), names.end(), workflowName) == names.end()) {
+        // Only the requested workflow is built, and only its plugins loaded
+        if (!manager.loadWorkflow(usedConfig, workflowName)) {
             cout << "Workflow '" << workflowName << "' not found.\n";
             curl_global_cleanup();
             return 1;
         }
+        if (!manager.preloadPlugins()) {
+            cout << "Aborting: not all plugins referenced by the config could be loaded.\n";
+            curl_global_cleanup();
+            return 1;
+        }
 
         cout << "Running workflow: " << workflowName << "\n";
         manager.startWorkflow(workflowName);
-        Logger::instance().log("Engine exited after running workflow: " + workflowName);
+        logPluginStats();
+        logRuleStats();
+        logDroppedLines();
+        FLOWFORGE_LOG("Engine exited after running workflow: {}", workflowName);
         curl_global_cleanup();
         return 0;
     }
 
+    if (argc >= 2 && string(argv[1]) == "daemon") {
+        int rc = runDaemon();
+        curl_global_cleanup();
+        return rc;
+    }
+
     printHeader();
 
     WorkflowManager manager;
-    // Locate config/workflows.json from several likely locations so running from build/ works
-    namespace fs = std::filesystem;
-    std::vector<std::string> candidates = {
-        "config/workflows.json",
-        "../config/workflows.json",
-        "./config/workflows.json",
-        "../../config/workflows.json"
-    };
-    std::string usedConfig;
-    for (const auto &c : candidates) {
-        if (fs::exists(c)) { usedConfig = c; break; }
-    }
+    std::string usedConfig = findConfig();
     if (usedConfig.empty()) {
-        cout << "No workflow config found (tried config/workflows.json and parent dirs).\n";
-        cout << "Please run from repository root or place config/workflows.json accordingly.\n";
         curl_global_cleanup();
         return 0;
     }
     cout << "Using workflow config: " << usedConfig << "\n";
     manager.loadWorkflows(usedConfig);
+    if (!manager.preloadPlugins()) {
+        cout << "Aborting: not all plugins referenced by the config could be loaded.\n";
+        curl_global_cleanup();
+        return 1;
+    }
 
     // Main menu loop
     bool running = true;
@@ -227,7 +303,10 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    Logger::instance().log("Engine exited.");
+    logPluginStats();
+    logRuleStats();
+    logDroppedLines();
+    FLOWFORGE_LOG("Engine exited.");
     curl_global_cleanup(); // Clean up curl on exit
     return 0;
 }
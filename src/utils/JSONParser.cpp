@@ -1,22 +1,183 @@
 #include "JSONParser.h"
-#include <fstream>
+#include "MappedFile.h"
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 using namespace std;
+using nlohmann::json;
+
+namespace {
+MappedFile mapOrThrow(const string& path) {
+    MappedFile file(path);
+    if (!file.isOpen()) throw JSONParser::ParseError("cannot open " + path, 0);
+    return file;
+}
+
+// SAX handler building a DOM like nlohmann's own, except that the elements
+// of one top-level array are handed out one at a time instead of stored
+struct StreamingHandler {
+    StreamingHandler(const std::string& arrayKey, const function<void(json&&)>& onElement)
+        : arrayKey_(arrayKey), onElement_(onElement) {}
+
+    json root;
+    std::string error;
+    size_t errorOffset = 0;
+
+    bool null() { return scalar(nullptr); }
+    bool boolean(bool v) { return scalar(v); }
+    bool number_integer(json::number_integer_t v) { return scalar(v); }
+    bool number_unsigned(json::number_unsigned_t v) { return scalar(v); }
+    bool number_float(json::number_float_t v, const json::string_t&) { return scalar(v); }
+    bool string(json::string_t& v) { return scalar(std::move(v)); }
+    bool binary(json::binary_t& v) { return scalar(json::binary(std::move(v))); }
+    bool key(json::string_t& k) {
+        key_ = std::move(k);
+        return true;
+    }
+    bool start_object(size_t) {
+        stack_.push_back(add(json::object()));
+        return true;
+    }
+    bool start_array(size_t) {
+        json* array = add(json::array());
+        if (stack_.size() == 1 && key_ == arrayKey_) streaming_ = true;
+        stack_.push_back(array);
+        return true;
+    }
+    bool end_object() { return end(); }
+    bool end_array() { return end(); }
+    bool parse_error(size_t position, const std::string&, const nlohmann::detail::exception& ex) {
+        error = ex.what();
+        errorOffset = position;
+        return false;
+    }
+private:
+    // Depth of the streamed array; its elements live in element_
+    static constexpr size_t kStreamDepth = 2;
+
+    template <typename V>
+    bool scalar(V&& v) {
+        if (streaming_ && stack_.size() == kStreamDepth) onElement_(json(std::forward<V>(v)));
+        else add(json(std::forward<V>(v)));
+        return true;
+    }
+    json* add(json&& v) {
+        if (stack_.empty()) {
+            root = std::move(v);
+            return &root;
+        }
+        if (streaming_ && stack_.size() == kStreamDepth) {
+            element_ = std::move(v);
+            return &element_;
+        }
+        json& top = *stack_.back();
+        if (top.is_array()) {
+            top.push_back(std::move(v));
+            return &top.back();
+        }
+        json& slot = top[key_];
+        slot = std::move(v);
+        return &slot;
+    }
+    bool end() {
+        stack_.pop_back();
+        if (streaming_ && stack_.size() == kStreamDepth) {
+            onElement_(std::move(element_));
+            element_ = json();
+        } else if (streaming_ && stack_.size() < kStreamDepth) {
+            streaming_ = false;
+        }
+        return true;
+    }
+
+    const std::string& arrayKey_;
+    const function<void(json&&)>& onElement_;
+    vector<json*> stack_;
+    std::string key_;
+    json element_;
+    bool streaming_ = false;
+};
+}
+
 nlohmann::json JSONParser::parseFile(const string& path) {
-    ifstream file(path);
-    nlohmann::json j;
-    if (!file.is_open()) {
+    MappedFile file(path);
+    if (!file.isOpen()) {
         // return empty object rather than attempting to parse
         return nlohmann::json::object();
     }
     try {
-        file >> j;
-    } catch (const std::exception &e) {
+        return nlohmann::json::parse(file.data(), file.data() + file.size());
+    } catch (const nlohmann::json::parse_error& e) {
         // return empty object on parse error to avoid exceptions bubbling up
+        cerr << "JSONParser: " << path << " is malformed at byte " << e.byte << "; ignoring it\n";
         return nlohmann::json::object();
     }
-    return j;
 }
-void JSONParser::writeFile(const string& path, const nlohmann::json& j) {
-    ofstream file(path);
-    file << j.dump(4);
+
+nlohmann::json JSONParser::parseFileStrict(const string& path) {
+    MappedFile file = mapOrThrow(path);
+    try {
+        return nlohmann::json::parse(file.data(), file.data() + file.size());
+    } catch (const nlohmann::json::parse_error& e) {
+        throw ParseError(path + ": " + e.what(), e.byte);
+    }
+}
+
+nlohmann::json JSONParser::stream(string_view text, const string& arrayKey,
+                                  const function<void(nlohmann::json&&)>& onElement) {
+    StreamingHandler handler(arrayKey, onElement);
+    if (!nlohmann::json::sax_parse(text.begin(), text.end(), &handler)) {
+        throw ParseError(handler.error, handler.errorOffset);
+    }
+    if (!handler.root.is_object()) throw ParseError("expected a top-level object", 0);
+    return std::move(handler.root);
+}
+
+nlohmann::json JSONParser::streamFile(const string& path, const string& arrayKey,
+                                      const function<void(nlohmann::json&&)>& onElement) {
+    MappedFile file = mapOrThrow(path);
+    try {
+        return stream(file.view(), arrayKey, onElement);
+    } catch (const ParseError& e) {
+        throw ParseError(path + ": " + e.what(), e.offset());
+    }
+}
+
+bool JSONParser::writeFile(const string& path, const nlohmann::json& j) {
+    return writeBytes(path, j.dump());
+}
+
+bool JSONParser::writeBytes(const string& path, string_view text) {
+    // Unique per call so concurrent writers never share a temporary
+    static atomic<uint64_t> counter{0};
+    string tmp = path + ".tmp." + to_string(::getpid()) + "." + to_string(counter.fetch_add(1));
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = true;
+    for (size_t done = 0; ok && done < text.size();) {
+        ssize_t n = ::write(fd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) done += static_cast<size_t>(n);
+    }
+    ok = ok && ::fsync(fd) == 0;
+    int err = errno;
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        if (ok) err = errno;
+        ::unlink(tmp.c_str());
+        errno = err;
+        return false;
+    }
+    // Make the rename itself durable
+    string dir = path.substr(0, path.find_last_of('/') + 1);
+    int dirFd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
 }
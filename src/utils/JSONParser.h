@@ -1,8 +1,41 @@
 #pragma once
 #include "json.hpp"
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 class JSONParser {
 public:
+    // Malformed or unreadable input; offset() is the byte at which parsing
+    // stopped (0 if the file could not be opened)
+    class ParseError : public std::runtime_error {
+    public:
+        ParseError(const std::string& what, size_t offset) : std::runtime_error(what), offset_(offset) {}
+        size_t offset() const { return offset_; }
+    private:
+        size_t offset_;
+    };
+
+    // Lenient: a missing or malformed file yields an empty object (a parse
+    // error is reported on stderr with its offset)
     static nlohmann::json parseFile(const std::string& path);
-    static void writeFile(const std::string& path, const nlohmann::json& j);
+    // Like parseFile, but throws ParseError
+    static nlohmann::json parseFileStrict(const std::string& path);
+    // Parses a top-level object without building it as a whole: each element
+    // of its `arrayKey` array is handed to `onElement` as soon as it is
+    // complete and then dropped. Returns the other members, with `arrayKey`
+    // (if present) mapped to an empty array. Throws ParseError; elements
+    // before the error have been handed over already.
+    static nlohmann::json stream(std::string_view text, const std::string& arrayKey,
+                                 const std::function<void(nlohmann::json&&)>& onElement);
+    static nlohmann::json streamFile(const std::string& path, const std::string& arrayKey,
+                                     const std::function<void(nlohmann::json&&)>& onElement);
+    // Replaces `path` atomically and durably: compact output goes to a
+    // temporary file that is fsynced and renamed over `path`, then the
+    // directory is fsynced. Readers see the old or the new file, never a
+    // partial one. Returns false with errno set if anything failed.
+    static bool writeFile(const std::string& path, const nlohmann::json& j);
+    // The same for bytes that are already encoded
+    static bool writeBytes(const std::string& path, std::string_view bytes);
 };
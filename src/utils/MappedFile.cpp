@@ -0,0 +1,58 @@
+#include "MappedFile.h"
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+MappedFile::MappedFile(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        mtimeNs_ = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            open_ = true;
+        } else {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                // Parsers walk the file front to back
+                ::madvise(p, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(p);
+                mapped_ = open_ = true;
+            } else {
+                size_ = 0;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    reset();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        reset();
+        data_ = exchange(other.data_, "");
+        size_ = exchange(other.size_, 0);
+        mapped_ = exchange(other.mapped_, false);
+        open_ = exchange(other.open_, false);
+        mtimeNs_ = exchange(other.mtimeNs_, 0);
+    }
+    return *this;
+}
+
+void MappedFile::reset() {
+    if (mapped_) ::munmap(const_cast<char*>(data_), size_);
+    data_ = "";
+    size_ = 0;
+    mapped_ = open_ = false;
+}
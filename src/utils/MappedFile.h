@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Read-only mapping of a whole file. isOpen() is false when the file
+// cannot be opened or mapped; an empty file maps to an empty view.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return open_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    std::string_view view() const { return { data_, size_ }; }
+    // Modification time when the file was mapped, in ns since the epoch
+    int64_t mtimeNs() const { return mtimeNs_; }
+private:
+    void reset();
+
+    const char* data_ = "";
+    size_t size_ = 0;
+    bool mapped_ = false;
+    bool open_ = false;
+    int64_t mtimeNs_ = 0;
+};